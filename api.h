@@ -0,0 +1,494 @@
+#ifndef API_H
+#define API_H
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "json.h"
+#include "templates.h"
+
+// Rows returned by GET /api/changes?since=N. Each changed entity appears once
+// with its current state, or in deleted if it no longer exists.
+
+struct ChangedUser {
+    std::string id;
+    std::string email;
+    std::string display_name;
+    std::string created_at;
+};
+
+struct ChangedPosition {
+    std::string id;
+    std::string title;
+    std::string created_by;
+    std::string created_at;
+    int candidate_count;
+};
+
+struct ChangedCandidate {
+    std::string id;
+    std::string position_id;
+    std::string name;
+    std::string student_feedback;
+    std::string created_at;
+};
+
+struct ChangedScore {
+    std::string id;
+    std::string candidate_id;
+    std::string interviewer_id;
+    int hand_gestures;
+    int stayed_awake;
+    std::string updated_at;
+};
+
+struct DeletedEntity {
+    std::string entity;     // "user", "position", "candidate" or "score"
+    std::string id;
+};
+
+struct ChangeSet {
+    int64_t version = 0;    // pass as since= on the next call
+    int64_t latest = 0;     // newest version in the log
+    bool more = false;      // true if changes after version were left out
+    std::vector<ChangedUser> users;
+    std::vector<ChangedPosition> positions;
+    std::vector<ChangedCandidate> candidates;
+    std::vector<ChangedScore> scores;
+    std::vector<DeletedEntity> deleted;
+};
+
+inline std::string changes_json(const ChangeSet& changes) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("version", static_cast<long long>(changes.version));
+    w.field("latest", static_cast<long long>(changes.latest));
+    w.field("more", changes.more);
+    w.key("users");
+    w.begin_array();
+    for (const ChangedUser& u : changes.users) {
+        w.begin_object();
+        w.field("id", u.id);
+        w.field("email", u.email);
+        w.field("display_name", u.display_name);
+        w.field("created_at", u.created_at);
+        w.end_object();
+    }
+    w.end_array();
+    w.key("positions");
+    w.begin_array();
+    for (const ChangedPosition& p : changes.positions) {
+        w.begin_object();
+        w.field("id", p.id);
+        w.field("title", p.title);
+        w.field("created_by", p.created_by);
+        w.field("created_at", p.created_at);
+        w.field("candidate_count", p.candidate_count);
+        w.end_object();
+    }
+    w.end_array();
+    w.key("candidates");
+    w.begin_array();
+    for (const ChangedCandidate& c : changes.candidates) {
+        w.begin_object();
+        w.field("id", c.id);
+        w.field("position_id", c.position_id);
+        w.field("name", c.name);
+        w.field("student_feedback", c.student_feedback);
+        w.field("created_at", c.created_at);
+        w.end_object();
+    }
+    w.end_array();
+    w.key("scores");
+    w.begin_array();
+    for (const ChangedScore& sc : changes.scores) {
+        w.begin_object();
+        w.field("id", sc.id);
+        w.field("candidate_id", sc.candidate_id);
+        w.field("interviewer_id", sc.interviewer_id);
+        w.field("hand_gestures", sc.hand_gestures);
+        w.field("stayed_awake", sc.stayed_awake);
+        w.field("updated_at", sc.updated_at);
+        w.end_object();
+    }
+    w.end_array();
+    w.key("deleted");
+    w.begin_array();
+    for (const DeletedEntity& d : changes.deleted) {
+        w.begin_object();
+        w.field("entity", d.entity);
+        w.field("id", d.id);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+// Reads a changes_json document back, for a follower applying the primary's
+// changes. False if body is not one.
+inline bool parse_changes(const std::string& body, ChangeSet& changes) {
+    JsonValue doc;
+    if (!json_parse(body, doc) || doc.type != JsonValue::Object) return false;
+    const JsonValue* version = doc.get("version");
+    if (!version || version->type != JsonValue::Number) return false;
+    changes.version = static_cast<int64_t>(version->number);
+    changes.latest = static_cast<int64_t>(doc.get_number("latest", version->number));
+    const JsonValue* more = doc.get("more");
+    changes.more = more && more->type == JsonValue::Bool && more->boolean;
+
+    auto each = [&](const char* key, auto&& fn) {
+        const JsonValue* list = doc.get(key);
+        if (!list || list->type != JsonValue::Array) return;
+        for (const JsonValue& item : list->items) fn(item);
+    };
+    each("users", [&](const JsonValue& u) {
+        changes.users.push_back({u.get_string("id"), u.get_string("email"), u.get_string("display_name"),
+                                 u.get_string("created_at")});
+    });
+    each("positions", [&](const JsonValue& p) {
+        changes.positions.push_back({p.get_string("id"), p.get_string("title"), p.get_string("created_by"),
+                                     p.get_string("created_at"), static_cast<int>(p.get_number("candidate_count"))});
+    });
+    each("candidates", [&](const JsonValue& c) {
+        changes.candidates.push_back({c.get_string("id"), c.get_string("position_id"), c.get_string("name"),
+                                      c.get_string("student_feedback"), c.get_string("created_at")});
+    });
+    each("scores", [&](const JsonValue& sc) {
+        changes.scores.push_back({sc.get_string("id"), sc.get_string("candidate_id"), sc.get_string("interviewer_id"),
+                                  static_cast<int>(sc.get_number("hand_gestures")),
+                                  static_cast<int>(sc.get_number("stayed_awake")), sc.get_string("updated_at")});
+    });
+    each("deleted", [&](const JsonValue& d) {
+        changes.deleted.push_back({d.get_string("entity"), d.get_string("id")});
+    });
+    return true;
+}
+
+// ---- /api/v1 ----
+//
+// The *_json functions mirror the page templates in templates.h but write
+// JSON straight from the Database visitors' borrowed rows.
+
+// Borrowed view of one interviewer's score, valid for the duration of the callback
+struct ScoreView {
+    std::string_view interviewer_id;
+    std::string_view interviewer_name;
+    int hand_gestures;
+    int stayed_awake;
+    std::string_view updated_at;
+};
+
+// Borrowed view of one saved version of a candidate's feedback
+struct FeedbackRevisionView {
+    int revision;
+    bool is_delta;          // stored as a delta against revision - 1
+    long long size;         // bytes of text
+    long long stored;       // bytes on disk
+    std::string_view created_at;
+};
+
+inline std::string api_error_json(std::string_view message) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("error", message);
+    w.end_object();
+    return out;
+}
+
+// Averages are null until someone has scored the candidate
+inline void write_averages(JsonWriter& w, int num_scores, double hand_gestures, double stayed_awake,
+                           double total) {
+    w.field("num_scores", num_scores);
+    if (num_scores > 0) {
+        w.field("avg_hand_gestures", hand_gestures);
+        w.field("avg_stayed_awake", stayed_awake);
+        w.field("avg_total", total);
+    } else {
+        w.key("avg_hand_gestures");
+        w.null();
+        w.key("avg_stayed_awake");
+        w.null();
+        w.key("avg_total");
+        w.null();
+    }
+}
+
+// for_each(emit) calls emit(const PositionView&) per row and returns the next
+// page's cursor, as for index_page_rows
+template <typename ForEachPosition>
+inline std::string positions_json(ForEachPosition&& for_each_position) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.key("positions");
+    w.begin_array();
+    std::string next = for_each_position([&](const PositionView& p) {
+        w.begin_object();
+        w.field("id", p.id);
+        w.field("title", p.title);
+        w.field("created_by_name", p.creator_name);
+        w.field("candidate_count", p.candidate_count);
+        w.end_object();
+    });
+    w.end_array();
+    w.key("next");
+    if (next.empty()) {
+        w.null();
+    } else {
+        w.value(next);
+    }
+    w.end_object();
+    return out;
+}
+
+// for_each(emit) calls emit(const CandidateRankingView&) in rank order
+template <typename ForEachCandidate>
+inline std::string position_json(const std::string& position_id, const std::string& title,
+                                 ForEachCandidate&& for_each_candidate) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("id", position_id);
+    w.field("title", title);
+    w.key("rankings");
+    w.begin_array();
+    int rank = 0;
+    for_each_candidate([&](const CandidateRankingView& c) {
+        w.begin_object();
+        w.field("rank", ++rank);
+        w.field("id", c.id);
+        w.field("name", c.name);
+        write_averages(w, c.num_scores, c.avg_hand_gestures, c.avg_stayed_awake, c.avg_total);
+        w.end_object();
+    });
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+inline std::string candidate_json(const CandidateDetail& candidate, const ScoreStats& stats,
+                                  const MyScore& my_score) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("id", candidate.id);
+    w.field("name", candidate.name);
+    w.field("position_id", candidate.position_id);
+    w.field("position_title", candidate.position_title);
+    // student_feedback is empty past Database::feedback_inline_max; the
+    // whole document is at GET /candidates/:id/feedback
+    w.field("student_feedback", candidate.student_feedback);
+    w.field("student_feedback_bytes", static_cast<long long>(candidate.feedback_size));
+    w.key("stats");
+    w.begin_object();
+    write_averages(w, stats.num_scores, stats.avg_hand_gestures, stats.avg_stayed_awake, stats.avg_total);
+    w.end_object();
+    w.key("my_score");
+    if (my_score.exists) {
+        w.begin_object();
+        w.field("hand_gestures", my_score.hand_gestures);
+        w.field("stayed_awake", my_score.stayed_awake);
+        w.end_object();
+    } else {
+        w.null();
+    }
+    w.end_object();
+    return out;
+}
+
+// Result of PUT /candidates/:id/feedback
+inline std::string feedback_upload_json(const std::string& candidate_id, size_t size, size_t stored) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("candidate_id", candidate_id);
+    w.field("bytes", static_cast<long long>(size));
+    w.field("stored_bytes", static_cast<long long>(stored));
+    w.end_object();
+    return out;
+}
+
+// for_each(emit) calls emit(const FeedbackRevisionView&) once per revision
+template <typename ForEachRevision>
+inline std::string feedback_revisions_json(const std::string& candidate_id, ForEachRevision&& for_each_revision) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("candidate_id", candidate_id);
+    w.key("revisions");
+    w.begin_array();
+    for_each_revision([&](const FeedbackRevisionView& r) {
+        w.begin_object();
+        w.field("revision", r.revision);
+        w.field("delta", r.is_delta);
+        w.field("bytes", r.size);
+        w.field("stored_bytes", r.stored);
+        w.field("created_at", r.created_at);
+        w.end_object();
+    });
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+// for_each(emit) calls emit(const ScoreView&) once per interviewer
+template <typename ForEachScore>
+inline std::string scores_json(const std::string& candidate_id, ForEachScore&& for_each_score) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("candidate_id", candidate_id);
+    w.key("scores");
+    w.begin_array();
+    for_each_score([&](const ScoreView& s) {
+        w.begin_object();
+        w.field("interviewer_id", s.interviewer_id);
+        w.field("interviewer_name", s.interviewer_name);
+        w.field("hand_gestures", s.hand_gestures);
+        w.field("stayed_awake", s.stayed_awake);
+        w.field("updated_at", s.updated_at);
+        w.end_object();
+    });
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+inline std::string highlighted_html(std::string_view text) {
+    std::ostringstream out;
+    out << highlighted(text);
+    return out.str();
+}
+
+// for_each(emit) calls emit(const SearchHitView&) best match first. Matches
+// are returned as HTML with <mark> around each matched term, as on /search.
+template <typename ForEachHit>
+inline std::string search_json(const std::string& query, ForEachHit&& for_each_hit) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("query", query);
+    w.key("results");
+    w.begin_array();
+    for_each_hit([&](const SearchHitView& hit) {
+        w.begin_object();
+        w.field("candidate_id", hit.candidate_id);
+        w.field("position_id", hit.position_id);
+        w.field("name_html", highlighted_html(hit.name));
+        w.field("position_title_html", highlighted_html(hit.position_title));
+        w.field("snippet_html", highlighted_html(hit.snippet));
+        w.key("score");
+        w.value(-hit.rank, 4);
+        w.end_object();
+    });
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+// One row of a bulk candidate import (see import.h)
+struct NewCandidate {
+    std::string name;
+    std::string student_feedback;
+};
+
+// One entry of POST /api/v1/scores
+struct ScoreSubmission {
+    std::string candidate_id;
+    int hand_gestures;
+    int stayed_awake;
+};
+
+struct ScoreResult {
+    std::string candidate_id;
+    std::string position_id;
+    ScoreStats stats;
+};
+
+struct BatchError {
+    size_t index;
+    std::string message;
+};
+
+// Reads {"scores":[{"candidate_id":"...","hand_gestures":1-5,"stayed_awake":1-5}, ...]}.
+// Every entry is checked before anything is written; errors lists each bad one.
+inline bool parse_score_batch(const std::string& body, size_t max_entries,
+                              std::vector<ScoreSubmission>& scores, std::vector<BatchError>& errors) {
+    JsonValue doc;
+    const JsonValue* list = nullptr;
+    if (json_parse(body, doc) && doc.type == JsonValue::Object) list = doc.get("scores");
+    if (!list || list->type != JsonValue::Array) {
+        errors.push_back({0, "body must be {\"scores\": [...]}"});
+        return false;
+    }
+    if (list->items.empty() || list->items.size() > max_entries) {
+        errors.push_back({0, "scores must hold 1 to " + std::to_string(max_entries) + " entries"});
+        return false;
+    }
+
+    scores.reserve(list->items.size());
+    for (size_t i = 0; i < list->items.size(); i++) {
+        const JsonValue& item = list->items[i];
+        std::string id = item.get_string("candidate_id");
+        double hg = item.get_number("hand_gestures", 0);
+        double sa = item.get_number("stayed_awake", 0);
+
+        if (id.empty() || id.find_first_not_of("0123456789abcdef-") != std::string::npos) {
+            errors.push_back({i, "candidate_id is missing or malformed"});
+        } else if (hg != static_cast<int>(hg) || sa != static_cast<int>(sa) ||
+                   hg < 1 || hg > 5 || sa < 1 || sa > 5) {
+            errors.push_back({i, "scores must be whole numbers between 1 and 5"});
+        } else {
+            bool duplicate = false;
+            for (const auto& s : scores) duplicate = duplicate || s.candidate_id == id;
+            if (duplicate) {
+                errors.push_back({i, "candidate appears more than once"});
+            }
+        }
+        scores.push_back({id, static_cast<int>(hg), static_cast<int>(sa)});
+    }
+    return errors.empty();
+}
+
+inline std::string batch_errors_json(const std::vector<BatchError>& errors) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.field("error", "no scores were saved");
+    w.key("errors");
+    w.begin_array();
+    for (const BatchError& e : errors) {
+        w.begin_object();
+        w.field("index", static_cast<long long>(e.index));
+        w.field("error", e.message);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+inline std::string score_results_json(const std::vector<ScoreResult>& results) {
+    std::string out;
+    JsonWriter w(out);
+    w.begin_object();
+    w.key("scores");
+    w.begin_array();
+    for (const ScoreResult& r : results) {
+        w.begin_object();
+        w.field("candidate_id", r.candidate_id);
+        write_averages(w, r.stats.num_scores, r.stats.avg_hand_gestures, r.stats.avg_stayed_awake,
+                       r.stats.avg_total);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return out;
+}
+
+#endif // API_H
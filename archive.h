@@ -0,0 +1,177 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sqlite3.h>
+#include "database.h"
+#include "json.h"
+#include "trace.h"
+
+// Moves closed positions out of the hot tables into the attached archive
+// database (<name>-archive.db), so the working set the scoring requests
+// touch stays the size of the open hiring rounds.
+//
+// Once a minute, or on POST /admin/archive, a background thread calls
+// Database::archive_step until nothing is left, chunk_candidates at a time
+// with a short pause between steps. The thread starts with the first
+// closed position: at open if one is waiting, else from wake() or start(). Reads of an archived position fall
+// back to the archive (see Database::archived), so pages, the API and
+// feedback downloads keep working throughout.
+//
+// Each step's hold on the shared connection is timed, as for backups.
+
+class ArchiveJob {
+public:
+    static constexpr int chunk_candidates = 10;
+    static constexpr auto step_pause = std::chrono::milliseconds(5);
+    static constexpr auto every = std::chrono::minutes(1);
+
+    explicit ArchiveJob(Database& db) : db_(db) {
+        if (enabled() && db_.has_closed_positions()) worker_ = std::thread([this] { run(); });
+    }
+
+    ~ArchiveJob() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    ArchiveJob(const ArchiveJob&) = delete;
+    ArchiveJob& operator=(const ArchiveJob&) = delete;
+
+    // Queues a pass now. False if one is already queued or running.
+    bool start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (requested_ || status_.running) return false;
+        requested_ = true;
+        launch();
+        cv_.notify_all();
+        return true;
+    }
+
+    // Call after closing a position; its pass comes round within every
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (enabled()) launch();
+    }
+
+    // Totals since startup, and the position being moved
+    std::string status_json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Status& s = status_;
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("enabled", enabled());
+        w.field("state", s.running ? "running" : requested_ ? "queued" : "idle");
+        if (!s.position_id.empty()) w.field("position_id", s.position_id);
+        w.field("passes", s.passes);
+        w.field("steps", s.steps);
+        w.field("positions_archived", s.positions);
+        w.field("candidates_copied", s.copied);
+        w.field("scores_copied", s.scores);
+        w.field("candidates_removed", s.removed);
+        w.field("errors", s.errors);
+        w.key("lock_ms_total");
+        w.value(s.lock_ns / 1e6, 3);
+        w.key("lock_ms_max");
+        w.value(s.lock_max_ns / 1e6, 3);
+        w.key("wait_ms_total");
+        w.value(s.wait_ns / 1e6, 3);
+        w.end_object();
+        return out;
+    }
+
+private:
+    struct Status {
+        bool running = false;
+        std::string position_id;
+        long long passes = 0;
+        long long steps = 0;
+        long long positions = 0;
+        long long copied = 0;
+        long long scores = 0;
+        long long removed = 0;
+        long long errors = 0;
+        uint64_t lock_ns = 0;       // holding the shared connection
+        uint64_t lock_max_ns = 0;
+        uint64_t wait_ns = 0;       // waiting for it
+    };
+
+    bool enabled() const { return db_.has_archive && !db_.replica; }
+
+    // Caller holds mutex_
+    void launch() {
+        if (!worker_.joinable()) worker_ = std::thread([this] { run(); });
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto next = std::chrono::steady_clock::now() + every;
+        while (!stopping_) {
+            cv_.wait_until(lock, next, [this] { return stopping_ || requested_; });
+            if (stopping_) break;
+            if (!requested_ && std::chrono::steady_clock::now() < next) continue;
+            requested_ = false;
+            status_.running = true;
+            status_.passes++;
+            lock.unlock();
+            archive();
+            lock.lock();
+            status_.running = false;
+            next = std::chrono::steady_clock::now() + every;
+        }
+    }
+
+    void archive() {
+        TRACE_SCOPE("archive");
+        sqlite3_mutex* conn = sqlite3_db_mutex(db_.db);
+        Database::ArchiveStep step;
+        while (true) {
+            uint64_t asked = Tracer::now_ns();
+            sqlite3_mutex_enter(conn);
+            uint64_t held = Tracer::now_ns();
+            bool moved = db_.archive_step(chunk_candidates, step);
+            uint64_t released = Tracer::now_ns();
+            sqlite3_mutex_leave(conn);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                status_.wait_ns += held - asked;
+                status_.lock_ns += released - held;
+                status_.lock_max_ns = std::max(status_.lock_max_ns, released - held);
+                if (!moved) {
+                    // Nothing left, or the step failed and rolled back
+                    if (!step.position_id.empty()) status_.errors++;
+                    status_.position_id.clear();
+                    break;
+                }
+                status_.steps++;
+                status_.position_id = step.position_id;
+                status_.copied += step.copied;
+                status_.scores += step.scores;
+                status_.removed += step.removed;
+                if (step.finished) status_.positions++;
+                if (stopping_) break;
+            }
+            std::this_thread::sleep_for(step_pause);
+        }
+    }
+
+    Database& db_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    bool requested_ = false;
+    Status status_;
+    std::thread worker_;
+};
+
+#endif // ARCHIVE_H
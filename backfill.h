@@ -0,0 +1,114 @@
+#ifndef BACKFILL_H
+#define BACKFILL_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sqlite3.h>
+#include "database.h"
+#include "json.h"
+#include "trace.h"
+
+// Runs the data migrations a schema upgrade queued (schema_backfills), so
+// opening an old database does not wait on them.
+//
+// When the database opens with work queued, a background thread calls
+// Database::backfill_step chunk_rows at a time with a short pause between
+// steps until nothing is queued, then exits. Queued work survives a
+// restart; the next open carries on from the stored position.
+//
+// Each step's hold on the shared connection is timed, as for backups.
+
+class BackfillJob {
+public:
+    static constexpr int chunk_rows = 500;
+    static constexpr auto step_pause = std::chrono::milliseconds(5);
+
+    explicit BackfillJob(Database& db) : db_(db) {
+        status_.running = db_.has_backfills();
+        if (status_.running) worker_ = std::thread([this] { run(); });
+    }
+
+    ~BackfillJob() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        if (worker_.joinable()) worker_.join();
+    }
+
+    BackfillJob(const BackfillJob&) = delete;
+    BackfillJob& operator=(const BackfillJob&) = delete;
+
+    std::string status_json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Status& s = status_;
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("state", s.running ? "running" : "done");
+        if (!s.task.empty()) w.field("task", s.task);
+        w.field("steps", s.steps);
+        w.field("rows", s.rows);
+        w.key("lock_ms_total");
+        w.value(s.lock_ns / 1e6, 3);
+        w.key("lock_ms_max");
+        w.value(s.lock_max_ns / 1e6, 3);
+        w.key("wait_ms_total");
+        w.value(s.wait_ns / 1e6, 3);
+        w.end_object();
+        return out;
+    }
+
+private:
+    struct Status {
+        bool running = false;
+        std::string task;           // the latest one worked on
+        long long steps = 0;
+        long long rows = 0;
+        uint64_t lock_ns = 0;       // holding the shared connection
+        uint64_t lock_max_ns = 0;
+        uint64_t wait_ns = 0;       // waiting for it
+    };
+
+    void run() {
+        TRACE_SCOPE("backfill");
+        sqlite3_mutex* conn = sqlite3_db_mutex(db_.db);
+        std::string task;
+        int rows = 0;
+        while (true) {
+            uint64_t asked = Tracer::now_ns();
+            sqlite3_mutex_enter(conn);
+            uint64_t held = Tracer::now_ns();
+            bool more = db_.backfill_step(chunk_rows, task, rows);
+            uint64_t released = Tracer::now_ns();
+            sqlite3_mutex_leave(conn);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                status_.wait_ns += held - asked;
+                status_.lock_ns += released - held;
+                status_.lock_max_ns = std::max(status_.lock_max_ns, released - held);
+                // Nothing queued, or the step failed and rolled back (tried
+                // again on the next open)
+                if (!more || stopping_) break;
+                status_.steps++;
+                status_.task = task;
+                status_.rows += rows;
+            }
+            std::this_thread::sleep_for(step_pause);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        status_.running = false;
+    }
+
+    Database& db_;
+    std::mutex mutex_;
+    bool stopping_ = false;
+    Status status_;
+    std::thread worker_;
+};
+
+#endif // BACKFILL_H
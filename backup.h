@@ -0,0 +1,292 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "database.h"
+#include "json.h"
+#include "tenants.h"
+#include "trace.h"
+
+// Online backups of the live database for /admin/backup.
+//
+// A background thread copies the database with the SQLite backup API a few
+// pages at a time, sleeping between steps so scoring requests never wait
+// long for the connection. The source is the shared connection itself:
+// writes made through it while a backup runs are applied to the copy as
+// they happen, so the backup never has to restart and ends up a consistent
+// snapshot as of its last step. The copy is written to a .part file and
+// renamed into place once complete.
+//
+// A pass copies the default database, then each faculty database in the
+// tenant directory (tenants.h) into <dir>/tenants/. A faculty that is open
+// is copied through its pool connection like the default one; the others
+// are read through a connection of the job's own, without opening them in
+// the pool.
+//
+// Each step's hold on the shared connection is timed; the status reports
+// the total and longest hold alongside throughput.
+
+class BackupJob {
+public:
+    static constexpr int pages_per_step = 64;
+    static constexpr auto step_pause = std::chrono::milliseconds(5);
+
+    // every of zero disables scheduled backups; POST /admin/backup still works
+    BackupJob(Database& db, TenantPool& tenants, std::string dir, std::chrono::minutes every)
+        : db_(db), tenants_(tenants), dir_(std::move(dir)), every_(every), worker_([this] { run(); }) {}
+
+    ~BackupJob() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+
+    BackupJob(const BackupJob&) = delete;
+    BackupJob& operator=(const BackupJob&) = delete;
+
+    // Queues a backup now. False if one is already queued or running.
+    bool start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (requested_ || status_.running) return false;
+        requested_ = true;
+        cv_.notify_all();
+        return true;
+    }
+
+    // Progress of the running backup, or the result of the last one
+    std::string status_json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Status& s = status_;
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("state", s.running ? "running" : requested_ ? "queued" : s.path.empty() ? "idle" : s.ok ? "done" : "failed");
+        w.field("path", s.path);
+        if (!s.error.empty()) w.field("error", s.error);
+        w.field("files_total", s.files_total);
+        w.field("files_done", s.files_done);
+        w.field("pages_total", s.pages_total);
+        w.field("pages_done", s.pages_done);
+        w.field("steps", s.steps);
+        w.key("elapsed_s");
+        w.value(s.elapsed_s, 3);
+        w.key("mb_per_s");
+        w.value(s.elapsed_s > 0 ? s.bytes_done / 1e6 / s.elapsed_s : 0.0, 1);
+        w.key("lock_ms_total");
+        w.value(s.lock_ns / 1e6, 3);
+        w.key("lock_ms_max");
+        w.value(s.lock_max_ns / 1e6, 3);
+        w.key("wait_ms_total");
+        w.value(s.wait_ns / 1e6, 3);
+        w.end_object();
+        return out;
+    }
+
+private:
+    struct Status {
+        bool running = false;
+        bool ok = false;
+        std::string path;           // the file being written, or the last one
+        std::string error;          // the last failure; the pass goes on
+        long long files_total = 0;
+        long long files_done = 0;
+        long long pages_total = 0;  // over the files started so far
+        long long pages_done = 0;
+        long long bytes_done = 0;
+        long long steps = 0;
+        double elapsed_s = 0;
+        uint64_t lock_ns = 0;       // holding the shared connection
+        uint64_t lock_max_ns = 0;
+        uint64_t wait_ns = 0;       // waiting for it
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto next = std::chrono::steady_clock::now() + every_;
+        while (!stopping_) {
+            if (every_.count() > 0) {
+                cv_.wait_until(lock, next, [this] { return stopping_ || requested_; });
+            } else {
+                cv_.wait(lock, [this] { return stopping_ || requested_; });
+            }
+            if (stopping_) break;
+            if (!requested_ && std::chrono::steady_clock::now() < next) continue;
+            requested_ = false;
+            status_ = Status();
+            status_.running = true;
+            lock.unlock();
+            backup();
+            lock.lock();
+            status_.running = false;
+            next = std::chrono::steady_clock::now() + every_;
+        }
+    }
+
+    void backup() {
+        TRACE_SCOPE("backup");
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::gmtime(&now));
+        std::vector<std::string> faculties = tenants_.names();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            status_.files_total = 1 + static_cast<long long>(faculties.size());
+        }
+        started_ = Tracer::now_ns();
+
+        copy(db_.db, dir_ + "/candidate_scoring-" + stamp + ".db");
+        for (const std::string& faculty : faculties) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopping_) return;
+            }
+            std::string path = dir_ + "/tenants/" + faculty + "-" + stamp + ".db";
+            // Held for the copy, so the pool cannot close it meanwhile
+            std::shared_ptr<Tenant> tenant = tenants_.find(faculty);
+            if (tenant) {
+                copy(tenant->db.db, path);
+                continue;
+            }
+            sqlite3* source = nullptr;
+            if (sqlite3_open_v2(tenants_.path(faculty).c_str(), &source, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+                copy(source, path);
+            } else {
+                fail(sqlite3_errmsg(source));
+            }
+            sqlite3_close(source);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        status_.ok = status_.error.empty();
+    }
+
+    // Copies source's main database to path. False (with the error in the
+    // status) if it could not.
+    bool copy(sqlite3* source, const std::string& path) {
+        std::string part = path + ".part";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            status_.path = path;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        std::filesystem::remove(part, ec);
+        sqlite3* dest = nullptr;
+        if (sqlite3_open(part.c_str(), &dest) != SQLITE_OK) {
+            fail(sqlite3_errmsg(dest));
+            sqlite3_close(dest);
+            return false;
+        }
+        // The last step commits the copy while holding the shared connection;
+        // sync it afterwards instead (the .part file is discarded on failure)
+        sqlite3_exec(dest, "PRAGMA synchronous = OFF; PRAGMA journal_mode = OFF", nullptr, nullptr, nullptr);
+        sqlite3_backup* b = sqlite3_backup_init(dest, "main", source, "main");
+        if (!b) {
+            fail(sqlite3_errmsg(dest));
+            sqlite3_close(dest);
+            return false;
+        }
+
+        long long size = page_size(source);
+        long long pages_before, done_before, bytes_before;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pages_before = status_.pages_total;
+            done_before = status_.pages_done;
+            bytes_before = status_.bytes_done;
+        }
+        sqlite3_mutex* conn = sqlite3_db_mutex(source);
+        int rc = SQLITE_OK;
+        while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            uint64_t asked = Tracer::now_ns();
+            sqlite3_mutex_enter(conn);
+            uint64_t held = Tracer::now_ns();
+            rc = sqlite3_backup_step(b, pages_per_step);
+            uint64_t released = Tracer::now_ns();
+            sqlite3_mutex_leave(conn);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                long long total = sqlite3_backup_pagecount(b);
+                long long done = total - sqlite3_backup_remaining(b);
+                status_.steps++;
+                status_.wait_ns += held - asked;
+                status_.lock_ns += released - held;
+                status_.lock_max_ns = std::max(status_.lock_max_ns, released - held);
+                status_.pages_total = pages_before + total;
+                status_.pages_done = done_before + done;
+                status_.bytes_done = bytes_before + done * size;
+                status_.elapsed_s = (released - started_) / 1e9;
+                if (stopping_) break;
+            }
+            if (rc != SQLITE_DONE) std::this_thread::sleep_for(step_pause);
+        }
+        sqlite3_backup_finish(b);
+        bool closed = sqlite3_close(dest) == SQLITE_OK;
+
+        if (rc == SQLITE_DONE && closed) closed = sync_file(part);
+        if (rc != SQLITE_DONE || !closed) {
+            fail(rc == SQLITE_DONE ? "could not write backup" : sqlite3_errstr(rc));
+            std::filesystem::remove(part, ec);
+            return false;
+        }
+        std::filesystem::rename(part, path, ec);
+        if (ec) {
+            fail(ec.message().c_str());
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        status_.files_done++;
+        return true;
+    }
+
+    static long long page_size(sqlite3* db) {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "PRAGMA page_size", -1, &stmt, nullptr);
+        long long size = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        return size;
+    }
+
+    static bool sync_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+    void fail(const char* error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        status_.ok = false;
+        status_.error = error ? error : "unknown error";
+    }
+
+    Database& db_;
+    TenantPool& tenants_;
+    std::string dir_;
+    std::chrono::minutes every_;
+    uint64_t started_ = 0;          // the current pass; worker thread only
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    bool requested_ = false;
+    Status status_;
+    std::thread worker_;
+};
+
+#endif // BACKUP_H
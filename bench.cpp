@@ -0,0 +1,275 @@
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "httplib.h"
+#include "bench_util.h"
+
+// Load generator for candidate_scoring.
+//
+//   ./bench --port 5000 --threads 8 --duration 30 --mode closed
+//   ./bench --mode open --rate 2000 --threads 32 --output bench.json
+//
+// Closed loop: each thread sends its next request as soon as the previous one
+// completes. Open loop: request k is due at start + k / rate on one shared
+// timeline; whichever thread is free takes the next one, so a slow response
+// does not push back the requests after it. Latency is measured from the due
+// time, so a stalled server shows up in the tail instead of silently lowering
+// the offered load. --threads caps the requests in flight: once all threads
+// are waiting on responses, due requests queue and the wait is counted.
+
+enum Route { HOME, POSITION, CANDIDATE, POST_SCORE, POST_FEEDBACK, ROUTE_COUNT };
+
+static const char* route_names[ROUTE_COUNT] = {
+    "GET /", "GET /positions/:id", "GET /candidates/:id",
+    "POST /candidates/:id score", "POST /candidates/:id feedback"
+};
+
+struct Dataset {
+    std::vector<std::string> position_ids;
+    std::vector<std::string> candidate_ids;
+};
+
+struct WorkerStats {
+    LatencyRecorder all;
+    LatencyRecorder by_route[ROUTE_COUNT];
+    size_t errors = 0;
+};
+
+// --faculty: every request goes to that faculty's database (X-SSO-Faculty)
+static std::string faculty;
+
+httplib::Headers user_headers(int user) {
+    std::string n = std::to_string(user);
+    httplib::Headers headers = {
+        {"X-SSO-User-ID", "bench-user-" + n},
+        {"X-SSO-Email", "bench-user-" + n + "@university.edu"},
+        {"X-SSO-Name", "Bench User " + n},
+    };
+    if (!faculty.empty()) headers.emplace("X-SSO-Faculty", faculty);
+    return headers;
+}
+
+std::vector<std::string> extract_ids(const std::string& html, const std::string& prefix) {
+    std::vector<std::string> ids;
+    std::regex re("href=\"/" + prefix + "/([a-f0-9-]{36})\"");
+    for (auto it = std::sregex_iterator(html.begin(), html.end(), re); it != std::sregex_iterator(); ++it) {
+        ids.push_back((*it)[1]);
+    }
+    return ids;
+}
+
+// Create positions and candidates through the normal HTTP routes
+bool seed(httplib::Client& cli, int positions, int candidates_per_position, Dataset& data) {
+    auto headers = user_headers(0);
+    for (int p = 0; p < positions; p++) {
+        auto res = cli.Post("/positions/new", headers, "title=Bench+Position+" + std::to_string(p),
+                            "application/x-www-form-urlencoded");
+        if (!res || !res->has_header("Location")) return false;
+        std::string location = res->get_header_value("Location");
+        std::string position_id = location.substr(location.rfind('/') + 1);
+        data.position_ids.push_back(position_id);
+
+        for (int c = 0; c < candidates_per_position; c++) {
+            auto cres = cli.Post("/positions/" + position_id + "/candidates/new", headers,
+                                 "name=Candidate+" + std::to_string(p) + "-" + std::to_string(c),
+                                 "application/x-www-form-urlencoded");
+            if (!cres || !cres->has_header("Location")) return false;
+            std::string cloc = cres->get_header_value("Location");
+            data.candidate_ids.push_back(cloc.substr(cloc.rfind('/') + 1));
+        }
+    }
+    return true;
+}
+
+// Reuse whatever is already in the database (e.g. from datagen)
+bool discover(httplib::Client& cli, size_t max_positions, Dataset& data) {
+    auto headers = user_headers(0);
+    auto res = cli.Get("/", headers);
+    if (!res || res->status != 200) return false;
+    data.position_ids = extract_ids(res->body, "positions");
+    if (data.position_ids.size() > max_positions) data.position_ids.resize(max_positions);
+    for (const auto& id : data.position_ids) {
+        auto pres = cli.Get("/positions/" + id, headers);
+        if (!pres || pres->status != 200) continue;
+        auto ids = extract_ids(pres->body, "candidates");
+        data.candidate_ids.insert(data.candidate_ids.end(), ids.begin(), ids.end());
+    }
+    return !data.candidate_ids.empty();
+}
+
+Route pick_route(std::mt19937& rng, const std::vector<int>& weights, int total) {
+    int r = std::uniform_int_distribution<>(0, total - 1)(rng);
+    for (int i = 0; i < ROUTE_COUNT; i++) {
+        if (r < weights[i]) return static_cast<Route>(i);
+        r -= weights[i];
+    }
+    return HOME;
+}
+
+httplib::Result send(httplib::Client& cli, Route route, const Dataset& data, std::mt19937& rng,
+                     const httplib::Headers& headers, const std::string& feedback) {
+    auto pick = [&](const std::vector<std::string>& v) -> const std::string& {
+        return v[std::uniform_int_distribution<size_t>(0, v.size() - 1)(rng)];
+    };
+    std::uniform_int_distribution<> score(1, 5);
+
+    switch (route) {
+        case HOME:
+            return cli.Get("/", headers);
+        case POSITION:
+            return cli.Get("/positions/" + pick(data.position_ids), headers);
+        case CANDIDATE:
+            return cli.Get("/candidates/" + pick(data.candidate_ids), headers);
+        case POST_SCORE:
+            return cli.Post("/candidates/" + pick(data.candidate_ids), headers,
+                            "action=score&hand_gestures=" + std::to_string(score(rng)) +
+                            "&stayed_awake=" + std::to_string(score(rng)),
+                            "application/x-www-form-urlencoded");
+        case POST_FEEDBACK:
+        default:
+            return cli.Post("/candidates/" + pick(data.candidate_ids), headers,
+                            "action=feedback&student_feedback=" + feedback,
+                            "application/x-www-form-urlencoded");
+    }
+}
+
+int main(int argc, char** argv) {
+    auto args = parse_args(argc, argv);
+    if (args.count("help")) {
+        std::cout << "usage: bench [--host H] [--port P] [--threads N] [--duration SECONDS]\n"
+                     "             [--mode closed|open] [--rate REQ_PER_SEC] [--users N]\n"
+                     "             [--seed-positions N] [--seed-candidates N] [--feedback-bytes N]\n"
+                     "             [--mix HOME,POSITION,CANDIDATE,SCORE,FEEDBACK] [--faculty NAME]\n"
+                     "             [--output FILE]\n";
+        return 0;
+    }
+
+    std::string host = arg_or(args, "host", "localhost");
+    int port = std::stoi(arg_or(args, "port", "5000"));
+    int threads = std::stoi(arg_or(args, "threads", "8"));
+    double duration = std::stod(arg_or(args, "duration", "10"));
+    std::string mode = arg_or(args, "mode", "closed");
+    double rate = std::stod(arg_or(args, "rate", "1000"));
+    int users = std::stoi(arg_or(args, "users", "20"));
+    int seed_positions = std::stoi(arg_or(args, "seed-positions", "10"));
+    int seed_candidates = std::stoi(arg_or(args, "seed-candidates", "8"));
+    size_t feedback_bytes = std::stoul(arg_or(args, "feedback-bytes", "400"));
+    std::string output = arg_or(args, "output", "-");
+    faculty = arg_or(args, "faculty", "");
+
+    std::vector<int> weights = {20, 30, 35, 10, 5};
+    std::string mix = arg_or(args, "mix", "");
+    if (!mix.empty()) {
+        std::istringstream ss(mix);
+        std::string w;
+        for (int i = 0; i < ROUTE_COUNT && std::getline(ss, w, ','); i++) weights[i] = std::stoi(w);
+    }
+    int total_weight = 0;
+    for (int w : weights) total_weight += w;
+    if (total_weight <= 0 || threads <= 0 || !(rate > 0) || (mode != "closed" && mode != "open")) {
+        std::cerr << "bench: invalid --mix, --threads, --rate or --mode" << std::endl;
+        return 1;
+    }
+
+    Dataset data;
+    {
+        httplib::Client cli(host, port);
+        bool ok = seed_positions > 0 ? seed(cli, seed_positions, seed_candidates, data)
+                                     : discover(cli, 50, data);
+        if (!ok || data.position_ids.empty() || data.candidate_ids.empty()) {
+            std::cerr << "bench: could not seed or discover positions/candidates at "
+                      << host << ":" << port << std::endl;
+            return 1;
+        }
+    }
+    std::cerr << "bench: " << data.position_ids.size() << " positions, "
+              << data.candidate_ids.size() << " candidates, " << mode << " loop, "
+              << threads << " threads, " << duration << "s" << std::endl;
+
+    // Feedback text, already form-encoded (letters and '+' only)
+    std::string feedback;
+    for (size_t i = 0; i < feedback_bytes; i++) feedback += (i % 8 == 7) ? '+' : static_cast<char>('a' + i % 26);
+
+    std::vector<WorkerStats> stats(threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(duration));
+    auto interval = std::chrono::duration<double>(1 / rate);
+    std::atomic<uint64_t> next_ticket{0};
+
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            httplib::Client cli(host, port);
+            cli.set_keep_alive(true);
+            cli.set_tcp_nodelay(true);
+            std::mt19937 rng(1234 + t);
+            WorkerStats& ws = stats[t];
+            std::chrono::steady_clock::time_point due;
+
+            while (true) {
+                auto now = std::chrono::steady_clock::now();
+                if (mode == "open") {
+                    uint64_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+                    due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval * ticket);
+                    if (due >= deadline) break;
+                    if (due > now) std::this_thread::sleep_until(due);
+                } else if (now >= deadline) {
+                    break;
+                }
+
+                Route route = pick_route(rng, weights, total_weight);
+                auto headers = user_headers(std::uniform_int_distribution<>(1, users)(rng));
+                auto sent = mode == "open" ? due : std::chrono::steady_clock::now();
+                auto res = send(cli, route, data, rng, headers, feedback);
+                double us = elapsed_us(sent, std::chrono::steady_clock::now());
+
+                if (!res || res->status >= 400) ws.errors++;
+                ws.all.add(us);
+                ws.by_route[route].add(us);
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LatencyRecorder all;
+    LatencyRecorder by_route[ROUTE_COUNT];
+    size_t errors = 0;
+    for (auto& ws : stats) {
+        all.merge(ws.all);
+        for (int r = 0; r < ROUTE_COUNT; r++) by_route[r].merge(ws.by_route[r]);
+        errors += ws.errors;
+    }
+
+    LatencySummary summary = all.summarize();
+    char head[256];
+    snprintf(head, sizeof(head),
+             "{\"tool\":\"bench\",\"mode\":\"%s\",\"threads\":%d,\"duration_s\":%.3f,"
+             "\"offered_rps\":%.1f,\"requests\":%zu,\"errors\":%zu,\"throughput_rps\":%.1f,",
+             mode.c_str(), threads, elapsed, mode == "open" ? rate : 0.0,
+             summary.count, errors, summary.count / elapsed);
+    std::string json = head;
+    json += "\"latency_us\":";
+    append_latency_json(json, summary);
+    json += ",\"routes\":{";
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        if (r) json += ',';
+        json += '"';
+        json_escape(json, route_names[r]);
+        json += "\":";
+        append_latency_json(json, by_route[r].summarize());
+    }
+    json += "}}";
+
+    if (!write_report(output, json)) {
+        std::cerr << "bench: cannot write " << output << std::endl;
+        return 1;
+    }
+    return errors == 0 ? 0 : 2;
+}
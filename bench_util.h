@@ -0,0 +1,111 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "json.h"
+
+// Shared pieces of the load-generation tools (bench, replay): latency
+// collection, percentile summaries and the JSON report format.
+
+struct LatencySummary {
+    size_t count = 0;
+    double mean_us = 0;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+};
+
+class LatencyRecorder {
+public:
+    void add(double micros) { samples_.push_back(micros); }
+
+    void merge(const LatencyRecorder& other) {
+        samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    }
+
+    size_t count() const { return samples_.size(); }
+
+    // Sorts the samples in place; call once collection has finished
+    LatencySummary summarize() {
+        LatencySummary s;
+        s.count = samples_.size();
+        if (samples_.empty()) return s;
+        std::sort(samples_.begin(), samples_.end());
+        double total = 0;
+        for (double v : samples_) total += v;
+        s.mean_us = total / samples_.size();
+        s.p50_us = percentile(0.50);
+        s.p90_us = percentile(0.90);
+        s.p99_us = percentile(0.99);
+        s.p999_us = percentile(0.999);
+        s.max_us = samples_.back();
+        return s;
+    }
+
+private:
+    double percentile(double q) const {
+        size_t rank = static_cast<size_t>(q * (samples_.size() - 1) + 0.5);
+        return samples_[std::min(rank, samples_.size() - 1)];
+    }
+
+    std::vector<double> samples_;
+};
+
+inline double elapsed_us(std::chrono::steady_clock::time_point start,
+                         std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+inline void append_latency_json(std::string& out, const LatencySummary& s) {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "{\"count\":%zu,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}",
+             s.count, s.mean_us, s.p50_us, s.p90_us, s.p99_us, s.p999_us, s.max_us);
+    out += buf;
+}
+
+// Write the report to path, or stdout when path is empty or "-"
+inline bool write_report(const std::string& path, const std::string& json) {
+    if (path.empty() || path == "-") {
+        std::fwrite(json.data(), 1, json.size(), stdout);
+        std::fputc('\n', stdout);
+        return true;
+    }
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    std::fwrite(json.data(), 1, json.size(), f);
+    std::fputc('\n', f);
+    std::fclose(f);
+    return true;
+}
+
+// Minimal "--name value" / "--flag" command-line parsing
+inline std::map<std::string, std::string> parse_args(int argc, char** argv) {
+    std::map<std::string, std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) continue;
+        std::string key = arg.substr(2);
+        if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+            args[key] = argv[++i];
+        } else {
+            args[key] = "1";
+        }
+    }
+    return args;
+}
+
+inline std::string arg_or(const std::map<std::string, std::string>& args, const std::string& key,
+                          const std::string& fallback) {
+    auto it = args.find(key);
+    return it != args.end() ? it->second : fallback;
+}
+
+#endif // BENCH_UTIL_H
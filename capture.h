@@ -0,0 +1,152 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "httplib.h"
+#include "json.h"
+
+// Request capture format shared by the server (writer) and replay (reader).
+// One JSON object per line:
+//
+//   {"timestamp":1760000000.123,"method":"POST","path":"/candidates/...",
+//    "headers":{"X-SSO-User-ID":"...","Content-Type":"..."},"body":"...",
+//    "status":200,"response_length":5321,"response_hash":"9f0c...",
+//    "response_hash_ids":"41d2..."}
+//
+// timestamp is Unix time in seconds. status and the response fields are
+// optional; replay diffs against them when present. response_hash_ids
+// hashes the body with every UUID masked, so ids generated afresh on replay
+// (new positions, candidates, scores) do not count as differences.
+
+struct CapturedRequest {
+    double timestamp = 0;
+    std::string method;
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    int status = 0;                // 0 = not recorded
+    long response_length = -1;     // -1 = not recorded
+    std::string response_hash;     // empty = not recorded
+    std::string response_hash_ids; // empty = not recorded
+};
+
+// FNV-1a 64-bit, hex encoded
+inline std::string body_hash(const std::string& body) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : body) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+}
+
+// body with the hex digits of every UUID (8-4-4-4-12) replaced by '0'
+inline std::string mask_uuids(std::string body) {
+    auto hex = [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); };
+    auto uuid_at = [&](size_t i) {
+        for (size_t k = 0; k < 36; k++) {
+            bool dash = k == 8 || k == 13 || k == 18 || k == 23;
+            if (dash ? body[i + k] != '-' : !hex(body[i + k])) return false;
+        }
+        return true;
+    };
+    for (size_t i = 0; i + 36 <= body.size();) {
+        if (!uuid_at(i)) {
+            i++;
+            continue;
+        }
+        for (size_t k = 0; k < 36; k++) {
+            if (body[i + k] != '-') body[i + k] = '0';
+        }
+        i += 36;
+    }
+    return body;
+}
+
+inline bool parse_capture(const std::string& line, CapturedRequest& out) {
+    JsonValue v;
+    if (!json_parse(line, v) || v.type != JsonValue::Object) return false;
+    out.method = v.get_string("method", "GET");
+    out.path = v.get_string("path");
+    out.body = v.get_string("body");
+    out.status = static_cast<int>(v.get_number("status", 0));
+    out.response_length = static_cast<long>(v.get_number("response_length", -1));
+    out.response_hash = v.get_string("response_hash");
+    out.response_hash_ids = v.get_string("response_hash_ids");
+
+    // Accept seconds or milliseconds since the epoch
+    const JsonValue* ts = v.get("timestamp");
+    if (ts && ts->type == JsonValue::Number) {
+        out.timestamp = ts->number > 1e11 ? ts->number / 1000.0 : ts->number;
+    }
+    if (const JsonValue* headers = v.get("headers")) {
+        for (const auto& m : headers->members) {
+            if (m.second.type == JsonValue::String) out.headers.emplace_back(m.first, m.second.str);
+        }
+    }
+    return !out.path.empty();
+}
+
+// Appends one line per completed request to a JSONL file. Only the SSO
+// identity headers and Content-Type are kept, which is all the routes read.
+class RequestCapture {
+public:
+    explicit RequestCapture(const std::string& path) : file_(std::fopen(path.c_str(), "a")) {}
+    ~RequestCapture() { if (file_) std::fclose(file_); }
+
+    RequestCapture(const RequestCapture&) = delete;
+    RequestCapture& operator=(const RequestCapture&) = delete;
+
+    bool is_open() const { return file_ != nullptr; }
+
+    void record(const httplib::Request& req, const httplib::Response& res) {
+        // Stamp with the arrival time, not the completion time
+        double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count() -
+                     std::chrono::duration<double>(std::chrono::steady_clock::now() - req.start_time_).count();
+        // target is the request line's path including the query string
+        const std::string& path = req.target.empty() ? req.path : req.target;
+
+        char head[64];
+        snprintf(head, sizeof(head), "{\"timestamp\":%.6f,\"method\":\"", now);
+        std::string line = head;
+        json_escape(line, req.method);
+        line += "\",\"path\":\"";
+        json_escape(line, path);
+        line += "\",\"headers\":{";
+        bool first = true;
+        for (const auto& h : req.headers) {
+            if (h.first.rfind("X-SSO-", 0) != 0 && h.first != "Content-Type") continue;
+            if (!first) line += ',';
+            first = false;
+            line += '"';
+            json_escape(line, h.first);
+            line += "\":\"";
+            json_escape(line, h.second);
+            line += '"';
+        }
+        line += "},\"body\":\"";
+        json_escape(line, req.body);
+        line += "\",\"status\":" + std::to_string(res.status);
+        line += ",\"response_length\":" + std::to_string(res.body.size());
+        line += ",\"response_hash\":\"" + body_hash(res.body) + "\"";
+        line += ",\"response_hash_ids\":\"" + body_hash(mask_uuids(res.body)) + "\"}\n";
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fwrite(line.data(), 1, line.size(), file_);
+        std::fflush(file_);
+    }
+
+private:
+    FILE* file_;
+    std::mutex mutex_;
+};
+
+#endif // CAPTURE_H
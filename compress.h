@@ -0,0 +1,75 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <string>
+#include <string_view>
+#include <sqlite3.h>
+#include <zlib.h>
+
+// Compressed text storage for candidate_feedback.body.
+//
+// Text is stored with a codec tag alongside its uncompressed size:
+//   codec 0  stored as-is (short text, or text that does not shrink)
+//   codec 1  zlib stream at the fastest level
+// The size lets unpack allocate once and inflate in a single call.
+
+enum TextCodec { text_raw = 0, text_zlib = 1 };
+
+// Below this, zlib's header and checksum outweigh anything it saves
+const size_t pack_min_size = 128;
+
+// Writes text's packed form to out and returns its codec
+inline int pack_text(std::string_view text, std::string& out) {
+    if (text.size() >= pack_min_size) {
+        uLongf len = compressBound(text.size());
+        out.resize(len);
+        if (compress2(reinterpret_cast<Bytef*>(&out[0]), &len, reinterpret_cast<const Bytef*>(text.data()),
+                      text.size(), Z_BEST_SPEED) == Z_OK && len < text.size()) {
+            out.resize(len);
+            return text_zlib;
+        }
+    }
+    out.assign(text.data(), text.size());
+    return text_raw;
+}
+
+// Inflates a packed body of the given codec and uncompressed size into out
+inline bool unpack_text(int codec, const void* body, size_t body_size, size_t size, std::string& out) {
+    if (codec == text_raw) {
+        out.assign(static_cast<const char*>(body), body_size);
+        return true;
+    }
+    if (codec != text_zlib) return false;
+    out.resize(size);
+    uLongf len = size;
+    if (uncompress(reinterpret_cast<Bytef*>(&out[0]), &len, static_cast<const Bytef*>(body), body_size) != Z_OK ||
+        len != size) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+// unpack_text(codec, size, body) as an SQL function, so queries and the
+// search index can read feedback without a round trip through C++
+inline void sql_unpack_text(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[2]) == SQLITE_NULL) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    const void* body = sqlite3_value_blob(argv[2]);
+    size_t body_size = sqlite3_value_bytes(argv[2]);
+    std::string text;
+    if (!unpack_text(sqlite3_value_int(argv[0]), body, body_size, sqlite3_value_int64(argv[1]), text)) {
+        sqlite3_result_error(ctx, "corrupt packed text", -1);
+        return;
+    }
+    sqlite3_result_text(ctx, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+}
+
+inline void register_unpack_text(sqlite3* db) {
+    sqlite3_create_function(db, "unpack_text", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                            sql_unpack_text, nullptr, nullptr);
+}
+
+#endif // COMPRESS_H
@@ -0,0 +1,2003 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+#include "templates.h"
+#include "api.h"
+#include "compress.h"
+#include "delta.h"
+#include "search.h"
+#include "trace.h"
+
+// Generate a UUID
+inline std::string generate_uuid() {
+    static std::random_device rd;
+    static std::mt19937 gen(rd());
+    static std::uniform_int_distribution<> dis(0, 15);
+    static const char* hex = "0123456789abcdef";
+
+    std::string uuid = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
+    for (char& c : uuid) {
+        if (c == 'x') {
+            c = hex[dis(gen)];
+        } else if (c == 'y') {
+            c = hex[(dis(gen) & 0x3) | 0x8];
+        }
+    }
+    return uuid;
+}
+
+// BEGIN IMMEDIATE ... COMMIT on a connection shared by the request threads.
+// The connection's own mutex is held throughout, so statements from other
+// threads cannot slip into (or be rolled back with) this transaction.
+// Rolls back if destroyed without commit(). Deferred is for snapshots that
+// only read: they take no write lock, so writers on other connections
+// (and the checkpointer) are not held up.
+class Transaction {
+public:
+    enum Mode { Immediate, Deferred };
+
+    explicit Transaction(sqlite3* db, Mode mode = Immediate) : db_(db) {
+        sqlite3_mutex_enter(sqlite3_db_mutex(db_));
+        sqlite3_exec(db_, mode == Immediate ? "BEGIN IMMEDIATE" : "BEGIN", nullptr, nullptr, nullptr);
+    }
+
+    ~Transaction() {
+        if (!committed_) sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+        sqlite3_mutex_leave(sqlite3_db_mutex(db_));
+    }
+
+    bool commit() {
+        committed_ = sqlite3_exec(db_, "COMMIT", nullptr, nullptr, nullptr) == SQLITE_OK;
+        return committed_;
+    }
+
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+private:
+    sqlite3* db_;
+    bool committed_ = false;
+};
+
+// Database wrapper
+class Database {
+public:
+    sqlite3* db;
+    // Set on a read-only follower (follower.h), which only writes through
+    // apply_changes
+    bool replica = false;
+    // The archive database is attached (see attach_archive)
+    bool has_archive = false;
+
+    // PRAGMA auto_vacuum value of every database this opens
+    static constexpr int incremental_auto_vacuum = 2;
+    // The archive's PRAGMA user_version
+    static constexpr int archive_schema_version = 1;
+    // user_version when opened, and how long opening took
+    int found_version = 0;
+    double open_ms = 0;
+
+    // Adds the candidate whose id is bound to ?1 to candidate_search
+    static constexpr const char* index_candidate_sql = R"(
+        INSERT INTO candidate_search (rowid, name, position_title, student_feedback)
+        SELECT c.rowid, c.name, p.title, COALESCE(unpack_text(f.codec, f.size, f.body), '')
+        FROM candidates c
+        JOIN positions p ON p.id = c.position_id
+        LEFT JOIN candidate_feedback f ON f.candidate_id = c.id
+        WHERE c.id = ?1
+    )";
+
+    Database(const std::string& path) {
+        uint64_t started = Tracer::now_ns();
+        if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+            throw std::runtime_error("Failed to open database");
+        }
+        sqlite3_exec(db, "PRAGMA foreign_keys = ON", nullptr, nullptr, nullptr);
+        // WAL lets read-only connections (exports) read a snapshot without
+        // blocking writes on this one, and vice versa
+        sqlite3_exec(db, "PRAGMA journal_mode = WAL", nullptr, nullptr, nullptr);
+        // Pages freed by deletes can be handed back a few at a time (see
+        // vacuum.h); takes effect when the file is created or vacuumed
+        sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL", nullptr, nullptr, nullptr);
+        register_unpack_text(db);
+        init_schema();
+        if (path != ":memory:") attach_archive(archive_path(path));
+        open_ms = (Tracer::now_ns() - started) / 1e6;
+    }
+
+    // Full-text index over candidates; rowid is candidates.rowid. Kept in
+    // sync by the Database write paths (index_candidate_sql) rather than
+    // triggers; rebuild_search_index() repopulates it. The 2 and 3 character
+    // prefix indexes keep search-as-you-type cheap.
+    static constexpr const char* search_table_sql = R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS candidate_search USING fts5(
+            name, position_title, student_feedback,
+            tokenize = 'unicode61 remove_diacritics 2',
+            prefix = '2 3'
+        );
+    )";
+
+    // migrations[v] takes the schema from version v to v + 1, in one
+    // transaction with the version bump. Append only. Version 0 is a new
+    // file or one from before versioning; upgrade_unversioned() handles it.
+    // A migration that changes a trigger drops it; create_triggers() puts
+    // the current one back in the same transaction.
+    static constexpr const char* migrations[] = {
+        nullptr,
+        // 1: candidate_rankings, leaving out archived positions (whose hot
+        // candidates are part deleted while they move)
+        R"(
+            DROP VIEW IF EXISTS candidate_rankings;
+            CREATE VIEW candidate_rankings AS
+            SELECT
+                c.id AS candidate_id,
+                c.name AS candidate_name,
+                c.position_id,
+                p.title AS position_title,
+                COUNT(s.id) AS num_scores,
+                ROUND(AVG(s.hand_gestures), 2) AS avg_hand_gestures,
+                ROUND(AVG(s.stayed_awake), 2) AS avg_stayed_awake,
+                ROUND((AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2, 2) AS avg_total
+            FROM candidates c
+            JOIN positions p ON c.position_id = p.id
+            LEFT JOIN scores s ON c.id = s.candidate_id
+            WHERE p.archived_at IS NULL
+            GROUP BY c.id, c.name, c.position_id, p.title;
+        )",
+        // 2: archiving no longer logs deletes or candidate_count changes
+        R"(
+            DROP TRIGGER IF EXISTS trg_candidates_count_delete;
+            DROP TRIGGER IF EXISTS trg_positions_log_delete;
+            DROP TRIGGER IF EXISTS trg_candidates_log_delete;
+            DROP TRIGGER IF EXISTS trg_scores_log_delete;
+        )",
+    };
+    // Kept in PRAGMA user_version
+    static constexpr int schema_version = sizeof(migrations) / sizeof(migrations[0]);
+
+    // Brings the schema up to schema_version. A current database costs one
+    // PRAGMA read and one trigger lookup.
+    void init_schema() {
+        TRACE_SCOPE("db.init_schema");
+        found_version = static_cast<int>(pragma_int("main.user_version"));
+        if (found_version > schema_version) {
+            throw std::runtime_error("Database schema version " + std::to_string(found_version) +
+                                     " is newer than this build");
+        }
+        int version = found_version;
+        // A bulk load that never reached end_bulk_load(); before the
+        // migrations, whose create_triggers() would skip the recount
+        if (version > 0 && !has_trigger("trg_candidates_count_insert")) {
+            create_indexes();
+            end_bulk_load();
+            queue_search_backfill();
+        }
+        if (version == 0) {
+            upgrade_unversioned();
+            version = 1;
+        }
+        for (; version < schema_version; version++) {
+            std::string bump = "PRAGMA user_version = " + std::to_string(version + 1) + "; COMMIT;";
+            try {
+                exec_schema((std::string("BEGIN IMMEDIATE;") + migrations[version]).c_str());
+                create_triggers();
+                exec_schema(bump.c_str());
+            } catch (...) {
+                sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+                throw;
+            }
+        }
+
+        // Uploads cut off by a restart
+        exec_schema("DELETE FROM feedback_uploads");
+    }
+
+    // New files, and files from before user_version was kept: creates what
+    // is missing, works out which older layout the file has and upgrades it
+    // to version 1
+    void upgrade_unversioned() {
+        const char* schema = R"(
+            CREATE TABLE IF NOT EXISTS users (
+                id TEXT PRIMARY KEY,
+                email TEXT NOT NULL UNIQUE,
+                display_name TEXT NOT NULL,
+                created_at TEXT NOT NULL DEFAULT (datetime('now'))
+            );
+
+            CREATE TABLE IF NOT EXISTS positions (
+                id TEXT PRIMARY KEY,
+                title TEXT NOT NULL,
+                created_by TEXT NOT NULL REFERENCES users(id),
+                created_at TEXT NOT NULL DEFAULT (datetime('now')),
+                candidate_count INTEGER NOT NULL DEFAULT 0,
+                closed_at TEXT,      -- no new candidates, scores or feedback
+                archived_at TEXT     -- reads go to the archive (see archive_step)
+            );
+
+            CREATE TABLE IF NOT EXISTS candidates (
+                id TEXT PRIMARY KEY,
+                position_id TEXT NOT NULL REFERENCES positions(id) ON DELETE CASCADE,
+                name TEXT NOT NULL,
+                created_at TEXT NOT NULL DEFAULT (datetime('now'))
+            );
+
+            -- Student feedback lives apart from candidates so that ranking and
+            -- listing scans read small rows; it is only read for the detail
+            -- page. body is packed by pack_text (compress.h), size is the
+            -- unpacked length in bytes.
+            CREATE TABLE IF NOT EXISTS candidate_feedback (
+                candidate_id TEXT PRIMARY KEY REFERENCES candidates(id) ON DELETE CASCADE,
+                codec INTEGER NOT NULL,
+                size INTEGER NOT NULL,
+                body BLOB NOT NULL
+            );
+
+            -- Every saved version of a candidate's feedback. A row is a full
+            -- snapshot, or a delta (delta.h) against the revision before it;
+            -- body is packed like candidate_feedback.body and text_size is the
+            -- revision's length in bytes.
+            CREATE TABLE IF NOT EXISTS feedback_revisions (
+                candidate_id TEXT NOT NULL REFERENCES candidates(id) ON DELETE CASCADE,
+                revision INTEGER NOT NULL,
+                is_delta INTEGER NOT NULL,
+                codec INTEGER NOT NULL,
+                size INTEGER NOT NULL,
+                text_size INTEGER NOT NULL,
+                body BLOB NOT NULL,
+                created_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+                PRIMARY KEY (candidate_id, revision)
+            );
+
+            CREATE TABLE IF NOT EXISTS scores (
+                id TEXT PRIMARY KEY,
+                candidate_id TEXT NOT NULL REFERENCES candidates(id) ON DELETE CASCADE,
+                interviewer_id TEXT NOT NULL REFERENCES users(id),
+                hand_gestures INTEGER NOT NULL CHECK (hand_gestures BETWEEN 1 AND 5),
+                stayed_awake INTEGER NOT NULL CHECK (stayed_awake BETWEEN 1 AND 5),
+                created_at TEXT NOT NULL DEFAULT (datetime('now')),
+                updated_at TEXT NOT NULL DEFAULT (datetime('now')),
+                UNIQUE (candidate_id, interviewer_id)
+            );
+
+            -- One row per changed entity, renumbered on every write, so the
+            -- log stays as small as the data and /api/changes reads a range.
+            -- The triggers delete and re-insert rather than INSERT OR REPLACE:
+            -- an UPSERT's own conflict policy would override the REPLACE.
+            CREATE TABLE IF NOT EXISTS change_log (
+                version INTEGER PRIMARY KEY AUTOINCREMENT,
+                entity TEXT NOT NULL,
+                entity_id TEXT NOT NULL,
+                op TEXT NOT NULL CHECK (op IN ('upsert', 'delete')),
+                UNIQUE (entity, entity_id)
+            );
+
+            -- How far a follower has applied each primary's change log
+            CREATE TABLE IF NOT EXISTS replication_state (
+                source TEXT PRIMARY KEY,
+                version INTEGER NOT NULL
+            );
+
+            -- Streamed feedback uploads in progress (see feedback.h); a row is
+            -- copied into candidate_feedback once its upload completes
+            CREATE TABLE IF NOT EXISTS feedback_uploads (
+                id INTEGER PRIMARY KEY,
+                candidate_id TEXT NOT NULL REFERENCES candidates(id) ON DELETE CASCADE,
+                body BLOB NOT NULL
+            );
+
+            -- Data migrations still to run (see backfill_step); after is how
+            -- far the task has got
+            CREATE TABLE IF NOT EXISTS schema_backfills (
+                name TEXT PRIMARY KEY,
+                after INTEGER NOT NULL DEFAULT 0
+            );
+        )";
+
+        // One transaction for the DDL and the version bump, so a crash
+        // leaves the file as it was. VACUUM cannot run inside it and comes
+        // after, once at most.
+        exec_schema("BEGIN IMMEDIATE");
+        bool vacuum = false;
+        try {
+            bool had_change_log = has_table("change_log");
+            bool had_user_log = has_trigger("trg_users_log_insert");
+            bool had_search = has_table("candidate_search");
+            exec_schema(schema);
+            exec_schema(search_table_sql);
+
+            // Databases created before candidate_count existed
+            if (!has_column("positions", "candidate_count")) {
+                exec_schema(R"(
+                    ALTER TABLE positions ADD COLUMN candidate_count INTEGER NOT NULL DEFAULT 0;
+                    UPDATE positions SET candidate_count =
+                        (SELECT COUNT(*) FROM candidates WHERE candidates.position_id = positions.id);
+                )");
+            }
+
+            // Databases created before positions could be closed
+            if (!has_column("positions", "closed_at")) {
+                exec_schema(R"(
+                    ALTER TABLE positions ADD COLUMN closed_at TEXT;
+                    ALTER TABLE positions ADD COLUMN archived_at TEXT;
+                )");
+            }
+
+            // Databases created before the change log: every existing row is new
+            if (!had_change_log) {
+                exec_schema(R"(
+                    INSERT OR IGNORE INTO change_log (entity, entity_id, op) SELECT 'position', id, 'upsert' FROM positions;
+                    INSERT OR IGNORE INTO change_log (entity, entity_id, op) SELECT 'candidate', id, 'upsert' FROM candidates;
+                    INSERT OR IGNORE INTO change_log (entity, entity_id, op) SELECT 'score', id, 'upsert' FROM scores;
+                )");
+            }
+
+            // Users joined the change log later; a follower needs them all
+            if (!had_user_log) {
+                exec_schema("INSERT OR IGNORE INTO change_log (entity, entity_id, op) SELECT 'user', id, 'upsert' FROM users");
+            }
+
+            // Databases that kept feedback inline in candidates. The shrunken
+            // rows only free pages once the file is rebuilt.
+            if (has_column("candidates", "student_feedback")) {
+                migrate_feedback();
+                vacuum = true;
+            }
+
+            // Databases created without incremental vacuum: switching it on
+            // takes one full VACUUM
+            if (pragma_int("main.auto_vacuum") != incremental_auto_vacuum) vacuum = true;
+
+            // VACUUM may renumber candidates' rowids, so the search index is
+            // refilled after it
+            if (!had_search || vacuum) queue_search_backfill();
+
+            create_indexes();
+            create_triggers();
+            exec_schema("PRAGMA user_version = 1; COMMIT;");
+        } catch (...) {
+            sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+            throw;
+        }
+        if (vacuum) exec_schema("VACUUM");
+    }
+
+    // Triggers that keep candidate_count and change_log up to date.
+    // Idempotent; see begin_bulk_load.
+    void create_triggers() {
+        exec_schema(R"(
+            -- positions.candidate_count is maintained here rather than counted per page load
+            CREATE TRIGGER IF NOT EXISTS trg_candidates_count_insert AFTER INSERT ON candidates BEGIN
+                UPDATE positions SET candidate_count = candidate_count + 1 WHERE id = NEW.position_id;
+            END;
+            -- Archived positions keep their count while archive_step deletes
+            -- their hot candidates; the position row goes last
+            CREATE TRIGGER IF NOT EXISTS trg_candidates_count_delete AFTER DELETE ON candidates
+            WHEN NOT EXISTS (SELECT 1 FROM positions WHERE id = OLD.position_id AND archived_at IS NOT NULL) BEGIN
+                UPDATE positions SET candidate_count = candidate_count - 1 WHERE id = OLD.position_id;
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_candidates_count_move AFTER UPDATE OF position_id ON candidates BEGIN
+                UPDATE positions SET candidate_count = candidate_count - 1 WHERE id = OLD.position_id;
+                UPDATE positions SET candidate_count = candidate_count + 1 WHERE id = NEW.position_id;
+            END;
+
+            -- Every write to users, positions, candidates and scores bumps the change log,
+            -- except archive_step's deletes: an archived row still exists, and
+            -- followers keep it (get_changes serves it from the archive)
+            CREATE TRIGGER IF NOT EXISTS trg_users_log_insert AFTER INSERT ON users BEGIN
+                DELETE FROM change_log WHERE entity = 'user' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('user', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_users_log_update AFTER UPDATE ON users BEGIN
+                DELETE FROM change_log WHERE entity = 'user' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('user', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_positions_log_insert AFTER INSERT ON positions BEGIN
+                DELETE FROM change_log WHERE entity = 'position' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('position', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_positions_log_update AFTER UPDATE ON positions BEGIN
+                DELETE FROM change_log WHERE entity = 'position' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('position', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_positions_log_delete AFTER DELETE ON positions
+            WHEN OLD.archived_at IS NULL BEGIN
+                DELETE FROM change_log WHERE entity = 'position' AND entity_id = OLD.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('position', OLD.id, 'delete');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_candidates_log_insert AFTER INSERT ON candidates BEGIN
+                DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_candidates_log_update AFTER UPDATE ON candidates BEGIN
+                DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_candidates_log_delete AFTER DELETE ON candidates
+            WHEN NOT EXISTS (SELECT 1 FROM positions WHERE id = OLD.position_id AND archived_at IS NOT NULL) BEGIN
+                DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = OLD.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', OLD.id, 'delete');
+            END;
+            -- Feedback is part of the candidate as far as /api/changes is concerned;
+            -- the cascade from a deleted candidate is already logged as a delete
+            CREATE TRIGGER IF NOT EXISTS trg_feedback_log_insert AFTER INSERT ON candidate_feedback BEGIN
+                DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.candidate_id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.candidate_id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_feedback_log_update AFTER UPDATE ON candidate_feedback BEGIN
+                DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.candidate_id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.candidate_id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_feedback_log_delete AFTER DELETE ON candidate_feedback
+            WHEN EXISTS (SELECT 1 FROM candidates WHERE id = OLD.candidate_id) BEGIN
+                DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = OLD.candidate_id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', OLD.candidate_id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_scores_log_insert AFTER INSERT ON scores BEGIN
+                DELETE FROM change_log WHERE entity = 'score' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('score', NEW.id, 'upsert');
+            END;
+            CREATE TRIGGER IF NOT EXISTS trg_scores_log_update AFTER UPDATE ON scores BEGIN
+                DELETE FROM change_log WHERE entity = 'score' AND entity_id = NEW.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('score', NEW.id, 'upsert');
+            END;
+            -- archive_step deletes scores before their candidates so this can tell
+            CREATE TRIGGER IF NOT EXISTS trg_scores_log_delete AFTER DELETE ON scores
+            WHEN NOT EXISTS (
+                SELECT 1 FROM candidates c JOIN positions p ON p.id = c.position_id
+                WHERE c.id = OLD.candidate_id AND p.archived_at IS NOT NULL
+            ) BEGIN
+                DELETE FROM change_log WHERE entity = 'score' AND entity_id = OLD.id;
+                INSERT INTO change_log (entity, entity_id, op) VALUES ('score', OLD.id, 'delete');
+            END;
+        )");
+    }
+
+    // For loads that bypass the write paths (datagen): drops the triggers so
+    // each inserted row costs one write instead of three or four.
+    // end_bulk_load() puts them back and brings candidate_count and the
+    // change log up to date in one statement each. The triggers go in one
+    // transaction, so a file opened after a crash mid-load has all or none;
+    // init_schema() finishes the load when they are missing.
+    void begin_bulk_load() {
+        Transaction txn(db);
+        std::vector<std::string> names;
+        {
+            Statement stmt(*this, "SELECT name FROM sqlite_master WHERE type = 'trigger' AND name LIKE 'trg\\_%' ESCAPE '\\'");
+            while (sqlite3_step(stmt) == SQLITE_ROW) names.push_back(column_string(stmt, 0));
+        }
+        for (const std::string& name : names) exec_schema(("DROP TRIGGER " + name).c_str());
+        if (!txn.commit()) throw std::runtime_error("Failed to start bulk load");
+    }
+
+    void end_bulk_load() {
+        Transaction txn(db);
+        exec_schema(R"(
+            UPDATE positions SET candidate_count =
+                (SELECT COUNT(*) FROM candidates WHERE candidates.position_id = positions.id);
+            INSERT OR IGNORE INTO change_log (entity, entity_id, op)
+                SELECT 'user', id, 'upsert' FROM users
+                UNION ALL SELECT 'position', id, 'upsert' FROM positions
+                UNION ALL SELECT 'candidate', id, 'upsert' FROM candidates
+                UNION ALL SELECT 'score', id, 'upsert' FROM scores;
+        )");
+        create_triggers();
+        if (!txn.commit()) throw std::runtime_error("Failed to finish bulk load");
+    }
+
+    // Secondary indexes. Idempotent: datagen drops them for a bulk load and
+    // calls this afterwards to build each in one sorted pass.
+    void create_indexes() {
+        exec_schema(R"(
+            CREATE INDEX IF NOT EXISTS idx_candidates_position ON candidates(position_id);
+            CREATE INDEX IF NOT EXISTS idx_scores_candidate ON scores(candidate_id);
+            CREATE INDEX IF NOT EXISTS idx_scores_interviewer ON scores(interviewer_id);
+            CREATE INDEX IF NOT EXISTS idx_positions_created_by ON positions(created_by);
+            CREATE INDEX IF NOT EXISTS idx_positions_created_at ON positions(created_at DESC, id DESC);
+            CREATE INDEX IF NOT EXISTS idx_positions_closed ON positions(closed_at) WHERE closed_at IS NOT NULL;
+        )");
+    }
+
+    // Empties candidate_search and queues it to be refilled a chunk at a
+    // time in the background (see backfill.h). Until then searches miss the
+    // candidates not yet reached.
+    void queue_search_backfill() {
+        exec_schema("DROP TABLE IF EXISTS candidate_search");
+        exec_schema(search_table_sql);
+        exec_schema("INSERT OR REPLACE INTO schema_backfills (name, after) VALUES ('candidate_search', 0)");
+    }
+
+    bool has_backfills() {
+        Statement queued(*this, "SELECT 1 FROM schema_backfills LIMIT 1");
+        return sqlite3_step(queued) == SQLITE_ROW;
+    }
+
+    // Runs up to limit rows of the oldest queued data migration in one
+    // transaction. False once none are queued. task gets its name and rows
+    // the rows it wrote.
+    bool backfill_step(int limit, std::string& task, int& rows) {
+        TRACE_SCOPE("db.backfill_step");
+        Transaction txn(db);
+        sqlite3_int64 after;
+        {
+            Statement next(*this, "SELECT name, after FROM schema_backfills ORDER BY rowid LIMIT 1");
+            if (sqlite3_step(next) != SQLITE_ROW) return false;
+            task = column_string(next, 0);
+            after = sqlite3_column_int64(next, 1);
+        }
+        rows = 0;
+        sqlite3_int64 upto = 0;
+        if (task == "candidate_search") {
+            Statement range(*this, "SELECT MAX(rowid) FROM (SELECT rowid FROM candidates WHERE rowid > ? ORDER BY rowid LIMIT ?)");
+            sqlite3_bind_int64(range, 1, after);
+            sqlite3_bind_int(range, 2, limit);
+            if (sqlite3_step(range) == SQLITE_ROW) upto = sqlite3_column_int64(range, 0);
+        }
+        if (upto > after) {
+            // Candidates written since the queueing are indexed already
+            Statement fill(*this, R"(
+                INSERT INTO candidate_search (rowid, name, position_title, student_feedback)
+                SELECT c.rowid, c.name, p.title, COALESCE(unpack_text(f.codec, f.size, f.body), '')
+                FROM candidates c
+                JOIN positions p ON p.id = c.position_id
+                LEFT JOIN candidate_feedback f ON f.candidate_id = c.id
+                WHERE c.rowid > ?1 AND c.rowid <= ?2
+                  AND NOT EXISTS (SELECT 1 FROM candidate_search s WHERE s.rowid = c.rowid)
+            )");
+            sqlite3_bind_int64(fill, 1, after);
+            sqlite3_bind_int64(fill, 2, upto);
+            if (sqlite3_step(fill) != SQLITE_DONE) return false;
+            rows = sqlite3_changes(db);
+        }
+        Statement done(*this, upto > after ? "UPDATE schema_backfills SET after = ?2 WHERE name = ?1"
+                                           : "DELETE FROM schema_backfills WHERE name = ?1");
+        sqlite3_bind_text(done, 1, task.c_str(), -1, SQLITE_TRANSIENT);
+        if (upto > after) sqlite3_bind_int64(done, 2, upto);
+        sqlite3_step(done);
+        return txn.commit();
+    }
+
+    // Repopulate candidate_search from scratch, e.g. after a bulk load that
+    // bypassed the write paths. Supersedes a queued backfill.
+    void rebuild_search_index() {
+        exec_schema(R"(
+            DELETE FROM schema_backfills WHERE name = 'candidate_search';
+            DELETE FROM candidate_search;
+            INSERT INTO candidate_search (rowid, name, position_title, student_feedback)
+                SELECT c.rowid, c.name, p.title, COALESCE(unpack_text(f.codec, f.size, f.body), '')
+                FROM candidates c
+                JOIN positions p ON p.id = c.position_id
+                LEFT JOIN candidate_feedback f ON f.candidate_id = c.id;
+        )");
+    }
+
+    // candidate_scoring.db keeps closed positions in candidate_scoring-archive.db
+    static std::string archive_path(const std::string& path) {
+        size_t ext = path.size() >= 3 && path.compare(path.size() - 3, 3, ".db") == 0 ? path.size() - 3 : path.size();
+        return path.substr(0, ext) + "-archive.db";
+    }
+
+    // Attaches the cold database that archive_step moves closed positions
+    // into. Its tables copy the hot tables' columns (without constraints;
+    // rows arrive already checked) and are indexed only for lookups by id.
+    // A column added to a hot table needs the same in the archive, and a
+    // bump of archive_schema_version.
+    void attach_archive(const std::string& path) {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS archive", -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+        has_archive = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!has_archive) return;
+        exec_schema("CREATE TEMP TABLE IF NOT EXISTS archive_batch (id TEXT PRIMARY KEY)");
+        if (pragma_int("archive.user_version") >= archive_schema_version) return;
+
+        exec_schema("PRAGMA archive.auto_vacuum = INCREMENTAL");
+        if (pragma_int("archive.auto_vacuum") != incremental_auto_vacuum) exec_schema("VACUUM archive");
+        exec_schema(R"(
+            PRAGMA archive.journal_mode = WAL;
+            CREATE TABLE IF NOT EXISTS archive.positions AS SELECT * FROM main.positions WHERE 0;
+            CREATE TABLE IF NOT EXISTS archive.candidates AS SELECT * FROM main.candidates WHERE 0;
+            CREATE TABLE IF NOT EXISTS archive.scores AS SELECT * FROM main.scores WHERE 0;
+            CREATE TABLE IF NOT EXISTS archive.candidate_feedback AS SELECT * FROM main.candidate_feedback WHERE 0;
+            CREATE TABLE IF NOT EXISTS archive.feedback_revisions AS SELECT * FROM main.feedback_revisions WHERE 0;
+            CREATE UNIQUE INDEX IF NOT EXISTS archive.idx_archive_positions ON positions(id);
+            CREATE UNIQUE INDEX IF NOT EXISTS archive.idx_archive_candidates ON candidates(id);
+            CREATE INDEX IF NOT EXISTS archive.idx_archive_candidates_position ON candidates(position_id);
+            CREATE UNIQUE INDEX IF NOT EXISTS archive.idx_archive_scores ON scores(id);
+            CREATE INDEX IF NOT EXISTS archive.idx_archive_scores_candidate ON scores(candidate_id);
+            CREATE UNIQUE INDEX IF NOT EXISTS archive.idx_archive_feedback ON candidate_feedback(candidate_id);
+            CREATE UNIQUE INDEX IF NOT EXISTS archive.idx_archive_revisions ON feedback_revisions(candidate_id, revision);
+        )");
+        exec_schema(("PRAGMA archive.user_version = " + std::to_string(archive_schema_version)).c_str());
+    }
+
+    // Packs candidates.student_feedback into candidate_feedback and drops the
+    // column, shrinking every candidate row. Runs in upgrade_unversioned's
+    // transaction.
+    void migrate_feedback() {
+        sqlite3_stmt* select;
+        sqlite3_stmt* insert;
+        sqlite3_prepare_v2(db, "SELECT id, student_feedback FROM candidates WHERE student_feedback <> ''",
+                           -1, &select, nullptr);
+        sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO candidate_feedback (candidate_id, codec, size, body) VALUES (?, ?, ?, ?)",
+                           -1, &insert, nullptr);
+        std::string packed;
+        while (sqlite3_step(select) == SQLITE_ROW) {
+            std::string_view feedback = column_view(select, 1);
+            bind_feedback(insert, 2, feedback, packed);
+            sqlite3_bind_text(insert, 1, column_view(select, 0).data(), -1, SQLITE_STATIC);
+            sqlite3_step(insert);
+            sqlite3_reset(insert);
+        }
+        sqlite3_finalize(select);
+        sqlite3_finalize(insert);
+        exec_schema("ALTER TABLE candidates DROP COLUMN student_feedback");
+    }
+
+    // Binds codec, size and body of feedback's packed form from index on;
+    // packed must outlive the statement step
+    static void bind_feedback(sqlite3_stmt* stmt, int index, std::string_view feedback, std::string& packed) {
+        int codec = pack_text(feedback, packed);
+        sqlite3_bind_int(stmt, index, codec);
+        sqlite3_bind_int64(stmt, index + 1, static_cast<sqlite3_int64>(feedback.size()));
+        sqlite3_bind_blob(stmt, index + 2, packed.data(), static_cast<int>(packed.size()), SQLITE_STATIC);
+    }
+
+    void exec_schema(const char* sql) {
+        char* err_msg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+            std::string error = err_msg ? err_msg : "Unknown error";
+            sqlite3_free(err_msg);
+            throw std::runtime_error("Failed to initialize schema: " + error);
+        }
+    }
+
+    bool has_column(const std::string& table, const std::string& column) {
+        std::string sql = "SELECT 1 FROM pragma_table_info('" + table + "') WHERE name = ?";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, column.c_str(), -1, SQLITE_TRANSIENT);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    bool has_trigger(const std::string& trigger) {
+        const char* sql = "SELECT 1 FROM sqlite_master WHERE type = 'trigger' AND name = ?";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, trigger.c_str(), -1, SQLITE_TRANSIENT);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    // A PRAGMA that reports one number, e.g. "main.freelist_count"
+    long long pragma_int(const std::string& pragma) {
+        std::string sql = "PRAGMA " + pragma;
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+        long long value = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        return value;
+    }
+
+    bool has_index(const std::string& index) {
+        const char* sql = "SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = ?";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, index.c_str(), -1, SQLITE_TRANSIENT);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    bool has_table(const std::string& table) {
+        const char* sql = "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, table.c_str(), -1, SQLITE_TRANSIENT);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    ~Database() {
+        for (auto& idle : idle_statements_) sqlite3_finalize(idle.second);
+        sqlite3_close(db);
+    }
+
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
+
+    // A prepared statement borrowed from this connection's cache, keyed by
+    // the address of its SQL literal. Each borrower gets a statement of its
+    // own (preparing another if every copy is out), and it goes back reset
+    // when the Statement is destroyed. Converts to sqlite3_stmt*.
+    class Statement {
+    public:
+        Statement(Database& owner, const char* sql) : owner_(owner), sql_(sql), stmt_(owner.borrow(sql)) {}
+        ~Statement() { owner_.give_back(sql_, stmt_); }
+
+        Statement(const Statement&) = delete;
+        Statement& operator=(const Statement&) = delete;
+
+        operator sqlite3_stmt*() const { return stmt_; }
+
+    private:
+        Database& owner_;
+        const char* sql_;
+        sqlite3_stmt* stmt_;
+    };
+
+    // sql with its hot tables swapped for the archive's copies, for reads
+    // that fall back to the archive. One string per query, so the statement
+    // cache sees a stable key.
+    const char* archived(const char* sql) {
+        static const std::regex tables(
+            R"(\b(FROM|JOIN)\s+(positions|candidates|scores|candidate_feedback|feedback_revisions)\b)");
+        std::lock_guard<std::mutex> lock(statements_mutex_);
+        auto it = archived_sql_.find(sql);
+        if (it == archived_sql_.end()) {
+            it = archived_sql_.emplace(sql, std::regex_replace(sql, tables, "$1 archive.$2")).first;
+        }
+        return it->second.c_str();
+    }
+
+    // Statements prepared for the cache so far, and borrows it satisfied
+    size_t statements_prepared() const { return statements_prepared_.load(); }
+    size_t statements_reused() const { return statements_reused_.load(); }
+
+    // Column text without copying; valid until the next step/reset/finalize
+    static std::string_view column_view(sqlite3_stmt* stmt, int col) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+        return text ? std::string_view(text, sqlite3_column_bytes(stmt, col)) : std::string_view();
+    }
+
+    static std::string column_string(sqlite3_stmt* stmt, int col) {
+        return std::string(column_view(stmt, col));
+    }
+
+    void ensure_user(const std::string& id, const std::string& email, const std::string& name) {
+        TRACE_SCOPE("db.ensure_user");
+        // A follower's users all come from its primary
+        if (replica) return;
+        const char* sql = "INSERT OR IGNORE INTO users (id, email, display_name) VALUES (?, ?, ?)";
+        Statement stmt(*this, sql);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, email.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+    }
+
+    // Calls fn(const PositionView&) for up to limit positions, newest first,
+    // starting after the position with id after_id (or from the top when
+    // empty). The views point into SQLite's row buffer and die with the row.
+    // Returns the cursor for the next page, or "" on the last page.
+    //
+    // Keyset pagination over idx_positions_created_at: each page is an index
+    // range scan of limit + 1 rows, however deep into the list it is.
+    template <typename Fn>
+    std::string for_each_position(const std::string& after_id, int limit, Fn&& fn) {
+        TRACE_SCOPE("db.for_each_position");
+        const char* first_page = R"(
+            SELECT p.id, p.title, u.display_name, p.candidate_count
+            FROM positions p
+            JOIN users u ON p.created_by = u.id
+            WHERE p.archived_at IS NULL
+            ORDER BY p.created_at DESC, p.id DESC
+            LIMIT ?2
+        )";
+        const char* next_page = R"(
+            SELECT p.id, p.title, u.display_name, p.candidate_count
+            FROM positions p
+            JOIN users u ON p.created_by = u.id
+            WHERE (p.created_at, p.id) < (SELECT created_at, id FROM positions WHERE id = ?1)
+              AND p.archived_at IS NULL
+            ORDER BY p.created_at DESC, p.id DESC
+            LIMIT ?2
+        )";
+        Statement stmt(*this, after_id.empty() ? first_page : next_page);
+        if (!after_id.empty()) sqlite3_bind_text(stmt, 1, after_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, limit + 1);
+
+        std::string next;
+        int rows = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            if (rows++ == limit) {
+                break;
+            }
+            PositionView p{column_view(stmt, 0), column_view(stmt, 1), column_view(stmt, 2),
+                           sqlite3_column_int(stmt, 3)};
+            if (rows == limit) next = std::string(p.id);
+            fn(p);
+        }
+        if (rows <= limit) next.clear();
+        return next;
+    }
+
+    std::vector<Position> get_positions(const std::string& after_id = "", int limit = 50) {
+        std::vector<Position> positions;
+        positions.reserve(limit);
+        for_each_position(after_id, limit, [&](const PositionView& p) {
+            positions.push_back({std::string(p.id), std::string(p.title), std::string(p.creator_name),
+                                 p.candidate_count});
+        });
+        return positions;
+    }
+
+    std::string create_position(const std::string& title, const std::string& user_id) {
+        TRACE_SCOPE("db.create_position");
+        std::string id = generate_uuid();
+        const char* sql = "INSERT INTO positions (id, title, created_by) VALUES (?, ?, ?)";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, title.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, user_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return id;
+    }
+
+    bool get_position(const std::string& id, std::string& title) {
+        bool closed;
+        return get_position(id, title, closed);
+    }
+
+    // closed: no longer taking candidates, scores or feedback. Falls back to
+    // the archive, whose positions are all closed.
+    bool get_position(const std::string& id, std::string& title, bool& closed) {
+        TRACE_SCOPE("db.get_position");
+        const char* sql = "SELECT title, closed_at IS NOT NULL FROM positions WHERE id = ? AND archived_at IS NULL";
+        auto lookup = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+            bool found = sqlite3_step(stmt) == SQLITE_ROW;
+            if (found) {
+                title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                closed = sqlite3_column_int(stmt, 1) != 0;
+            }
+            return found;
+        };
+        return lookup(sql) || (has_archive && lookup(archived(sql)));
+    }
+
+    // Calls fn(const CandidateRankingView&) for each candidate in rank order
+    // while the statement is stepping
+    template <typename Fn>
+    void for_each_candidate_ranking(const std::string& position_id, Fn&& fn) {
+        TRACE_SCOPE("db.for_each_candidate_ranking");
+        const char* sql = R"(
+            SELECT c.id, c.name, COUNT(s.id), AVG(s.hand_gestures), AVG(s.stayed_awake),
+                   (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2
+            FROM candidates c
+            LEFT JOIN scores s ON c.id = s.candidate_id
+            WHERE c.position_id = ?1 AND (SELECT archived_at FROM positions WHERE id = ?1) IS NULL
+            GROUP BY c.id
+            ORDER BY (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2 DESC NULLS LAST, c.name
+        )";
+        auto rank = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, position_id.c_str(), -1, SQLITE_TRANSIENT);
+            int rows = 0;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                rows++;
+                fn(CandidateRankingView{
+                    column_view(stmt, 0),
+                    column_view(stmt, 1),
+                    sqlite3_column_int(stmt, 2),
+                    sqlite3_column_type(stmt, 3) != SQLITE_NULL ? sqlite3_column_double(stmt, 3) : 0,
+                    sqlite3_column_type(stmt, 4) != SQLITE_NULL ? sqlite3_column_double(stmt, 4) : 0,
+                    sqlite3_column_type(stmt, 5) != SQLITE_NULL ? sqlite3_column_double(stmt, 5) : 0,
+                });
+            }
+            return rows;
+        };
+        if (rank(sql) == 0 && has_archive) rank(archived(sql));
+    }
+
+    std::vector<CandidateRanking> get_candidates_for_position(const std::string& position_id) {
+        std::vector<CandidateRanking> candidates;
+        for_each_candidate_ranking(position_id, [&](const CandidateRankingView& c) {
+            candidates.push_back({std::string(c.id), std::string(c.name), c.num_scores,
+                                  c.avg_hand_gestures, c.avg_stayed_awake, c.avg_total});
+        });
+        return candidates;
+    }
+
+    std::string create_candidate(const std::string& position_id, const std::string& name) {
+        TRACE_SCOPE("db.create_candidate");
+        Transaction txn(db);
+        std::string id = generate_uuid();
+        const char* sql = "INSERT INTO candidates (id, position_id, name) VALUES (?, ?, ?)";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, position_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        sqlite3_prepare_v2(db, index_candidate_sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        txn.commit();
+        return id;
+    }
+
+    // Insert a batch of candidates in one transaction with one reused
+    // statement. Returns the number inserted.
+    size_t create_candidates(const std::string& position_id, const std::vector<NewCandidate>& rows) {
+        TRACE_SCOPE("db.create_candidates");
+        Transaction txn(db);
+        const char* sql = "INSERT INTO candidates (id, position_id, name) VALUES (?, ?, ?)";
+        sqlite3_stmt* stmt;
+        sqlite3_stmt* feedback;
+        sqlite3_stmt* index;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_prepare_v2(db, "INSERT INTO candidate_feedback (candidate_id, codec, size, body) VALUES (?, ?, ?, ?)",
+                           -1, &feedback, nullptr);
+        sqlite3_prepare_v2(db, index_candidate_sql, -1, &index, nullptr);
+        sqlite3_bind_text(stmt, 2, position_id.c_str(), -1, SQLITE_STATIC);
+        size_t inserted = 0;
+        std::string packed;
+        for (const NewCandidate& c : rows) {
+            std::string id = generate_uuid();
+            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, c.name.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_DONE) {
+                inserted++;
+                if (!c.student_feedback.empty()) {
+                    sqlite3_bind_text(feedback, 1, id.c_str(), -1, SQLITE_STATIC);
+                    bind_feedback(feedback, 2, c.student_feedback, packed);
+                    sqlite3_step(feedback);
+                    sqlite3_reset(feedback);
+                }
+                sqlite3_bind_text(index, 1, id.c_str(), -1, SQLITE_STATIC);
+                sqlite3_step(index);
+                sqlite3_reset(index);
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_finalize(feedback);
+        sqlite3_finalize(index);
+        return txn.commit() ? inserted : 0;
+    }
+
+    // Without student_feedback, which only get_candidate_detail loads
+    bool get_candidate(const std::string& id, CandidateDetail& candidate) {
+        TRACE_SCOPE("db.get_candidate");
+        const char* sql = R"(
+            SELECT c.id, c.name, c.position_id, p.title, p.closed_at IS NOT NULL
+            FROM candidates c
+            JOIN positions p ON c.position_id = p.id
+            WHERE c.id = ? AND p.archived_at IS NULL
+        )";
+        auto lookup = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+            bool found = sqlite3_step(stmt) == SQLITE_ROW;
+            if (found) {
+                candidate.id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                candidate.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                candidate.position_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+                candidate.position_title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+                candidate.student_feedback.clear();
+                candidate.closed = sqlite3_column_int(stmt, 4) != 0;
+            }
+            return found;
+        };
+        return lookup(sql) || (has_archive && lookup(archived(sql)));
+    }
+
+    // Feedback longer than this is left out of the detail page and served
+    // by GET /candidates/:id/feedback instead
+    static constexpr size_t feedback_inline_max = 64 * 1024;
+
+    // Candidate, position title, aggregate scores and the caller's own score
+    // in one statement, so the detail page sees a single consistent snapshot
+    bool get_candidate_detail(const std::string& candidate_id, const std::string& user_id,
+                              CandidateDetail& candidate, ScoreStats& stats, MyScore& my_score) {
+        TRACE_SCOPE("db.get_candidate_detail");
+        const char* sql = R"(
+            SELECT c.id, c.name, c.position_id, p.title,
+                   COALESCE((SELECT unpack_text(codec, size, body) FROM candidate_feedback
+                             WHERE candidate_id = c.id AND size <= ?3), ''),
+                   COUNT(s.id), AVG(s.hand_gestures), AVG(s.stayed_awake),
+                   (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2,
+                   MAX(CASE WHEN s.interviewer_id = ?2 THEN s.hand_gestures END),
+                   MAX(CASE WHEN s.interviewer_id = ?2 THEN s.stayed_awake END),
+                   COALESCE((SELECT size FROM candidate_feedback WHERE candidate_id = c.id), 0),
+                   p.closed_at IS NOT NULL
+            FROM candidates c
+            JOIN positions p ON c.position_id = p.id
+            LEFT JOIN scores s ON s.candidate_id = c.id
+            WHERE c.id = ?1 AND p.archived_at IS NULL
+            GROUP BY c.id
+        )";
+        auto lookup = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, user_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(feedback_inline_max));
+            bool found = sqlite3_step(stmt) == SQLITE_ROW;
+            if (found) {
+                candidate.id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                candidate.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                candidate.position_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+                candidate.position_title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+                candidate.student_feedback = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+                candidate.feedback_size = static_cast<size_t>(sqlite3_column_int64(stmt, 11));
+                candidate.closed = sqlite3_column_int(stmt, 12) != 0;
+
+                stats = {0, 0, 0, 0};
+                stats.num_scores = sqlite3_column_int(stmt, 5);
+                if (stats.num_scores > 0) {
+                    stats.avg_hand_gestures = sqlite3_column_double(stmt, 6);
+                    stats.avg_stayed_awake = sqlite3_column_double(stmt, 7);
+                    stats.avg_total = sqlite3_column_double(stmt, 8);
+                }
+
+                my_score = {false, 0, 0};
+                if (sqlite3_column_type(stmt, 9) != SQLITE_NULL) {
+                    my_score.exists = true;
+                    my_score.hand_gestures = sqlite3_column_int(stmt, 9);
+                    my_score.stayed_awake = sqlite3_column_int(stmt, 10);
+                }
+            }
+            return found;
+        };
+        return lookup(sql) || (has_archive && lookup(archived(sql)));
+    }
+
+    ScoreStats get_score_stats(const std::string& candidate_id) {
+        TRACE_SCOPE("db.get_score_stats");
+        ScoreStats stats = {0, 0, 0, 0};
+        const char* sql = R"(
+            SELECT COUNT(*), AVG(hand_gestures), AVG(stayed_awake),
+                   (AVG(hand_gestures) + AVG(stayed_awake)) / 2
+            FROM scores WHERE candidate_id = ?
+        )";
+        Statement stmt(*this, sql);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            stats.num_scores = sqlite3_column_int(stmt, 0);
+            if (stats.num_scores > 0) {
+                stats.avg_hand_gestures = sqlite3_column_double(stmt, 1);
+                stats.avg_stayed_awake = sqlite3_column_double(stmt, 2);
+                stats.avg_total = sqlite3_column_double(stmt, 3);
+            }
+        }
+        return stats;
+    }
+
+    // Insert or update the caller's score and read the candidate's new
+    // aggregate into stats, in the same transaction as the write. Returns
+    // false and writes nothing if the candidate does not exist or its
+    // position is closed; the check is part of the write, so a close that
+    // lands after the caller looked cannot let a score in.
+    bool upsert_score(const std::string& candidate_id, const std::string& user_id, int hand_gestures, int stayed_awake,
+                      ScoreStats& stats) {
+        TRACE_SCOPE("db.upsert_score");
+        Transaction txn(db);
+        std::string id = generate_uuid();
+        const char* sql = R"(
+            INSERT INTO scores (id, candidate_id, interviewer_id, hand_gestures, stayed_awake)
+            SELECT ?1, ?2, ?3, ?4, ?5
+            WHERE EXISTS (
+                SELECT 1 FROM candidates c JOIN positions p ON p.id = c.position_id
+                WHERE c.id = ?2 AND p.closed_at IS NULL
+            )
+            ON CONFLICT (candidate_id, interviewer_id) DO UPDATE SET
+                hand_gestures = excluded.hand_gestures,
+                stayed_awake = excluded.stayed_awake,
+                updated_at = datetime('now')
+        )";
+        Statement stmt(*this, sql);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, user_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 4, hand_gestures);
+        sqlite3_bind_int(stmt, 5, stayed_awake);
+        if (sqlite3_step(stmt) != SQLITE_DONE || sqlite3_changes(db) == 0) return false;
+
+        stats = get_score_stats(candidate_id);
+        return txn.commit();
+    }
+
+    // Write the caller's scores for several candidates in one transaction,
+    // reusing one prepared statement per step across rows. Returns false and
+    // writes nothing if any candidate does not exist (or its position is
+    // closed); missing gets their indexes.
+    bool upsert_scores(const std::string& user_id, const std::vector<ScoreSubmission>& scores,
+                       std::vector<ScoreResult>& results, std::vector<size_t>& missing) {
+        TRACE_SCOPE("db.upsert_scores");
+        Transaction txn(db);
+        sqlite3_stmt* lookup;
+        sqlite3_stmt* upsert;
+        sqlite3_stmt* stats;
+        sqlite3_prepare_v2(db, R"(
+            SELECT c.position_id FROM candidates c JOIN positions p ON p.id = c.position_id
+            WHERE c.id = ? AND p.closed_at IS NULL
+        )", -1, &lookup, nullptr);
+        sqlite3_prepare_v2(db, R"(
+            INSERT INTO scores (id, candidate_id, interviewer_id, hand_gestures, stayed_awake)
+            VALUES (?, ?, ?, ?, ?)
+            ON CONFLICT (candidate_id, interviewer_id) DO UPDATE SET
+                hand_gestures = excluded.hand_gestures,
+                stayed_awake = excluded.stayed_awake,
+                updated_at = datetime('now')
+        )", -1, &upsert, nullptr);
+        sqlite3_prepare_v2(db, R"(
+            SELECT COUNT(*), AVG(hand_gestures), AVG(stayed_awake),
+                   (AVG(hand_gestures) + AVG(stayed_awake)) / 2
+            FROM scores WHERE candidate_id = ?
+        )", -1, &stats, nullptr);
+
+        results.reserve(scores.size());
+        for (size_t i = 0; i < scores.size(); i++) {
+            sqlite3_bind_text(lookup, 1, scores[i].candidate_id.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(lookup) == SQLITE_ROW) {
+                results.push_back({scores[i].candidate_id, column_string(lookup, 0), {0, 0, 0, 0}});
+            } else {
+                missing.push_back(i);
+            }
+            sqlite3_reset(lookup);
+        }
+
+        if (missing.empty()) {
+            // user_id stays bound across rows; SQLITE_STATIC is safe because
+            // the strings outlive the statements
+            sqlite3_bind_text(upsert, 3, user_id.c_str(), -1, SQLITE_STATIC);
+            for (size_t i = 0; i < scores.size(); i++) {
+                sqlite3_bind_text(upsert, 1, generate_uuid().c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(upsert, 2, scores[i].candidate_id.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_int(upsert, 4, scores[i].hand_gestures);
+                sqlite3_bind_int(upsert, 5, scores[i].stayed_awake);
+                sqlite3_step(upsert);
+                sqlite3_reset(upsert);
+
+                ScoreStats& s = results[i].stats;
+                sqlite3_bind_text(stats, 1, scores[i].candidate_id.c_str(), -1, SQLITE_STATIC);
+                if (sqlite3_step(stats) == SQLITE_ROW) {
+                    s.num_scores = sqlite3_column_int(stats, 0);
+                    if (s.num_scores > 0) {
+                        s.avg_hand_gestures = sqlite3_column_double(stats, 1);
+                        s.avg_stayed_awake = sqlite3_column_double(stats, 2);
+                        s.avg_total = sqlite3_column_double(stats, 3);
+                    }
+                }
+                sqlite3_reset(stats);
+            }
+        }
+
+        sqlite3_finalize(lookup);
+        sqlite3_finalize(upsert);
+        sqlite3_finalize(stats);
+        return missing.empty() && txn.commit();
+    }
+
+    // Revisions between full snapshots in feedback_revisions, bounding how
+    // many deltas get_feedback_revision applies
+    static constexpr int feedback_snapshot_every = 16;
+
+    // Latest revision number, 0 if none. Feedback saved before revisions
+    // were kept (or by an import) becomes revision 1 on its first change.
+    int begin_feedback_history(const std::string& candidate_id) {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "SELECT MAX(revision) FROM feedback_revisions WHERE candidate_id = ?", -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        int latest = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        if (latest > 0) return latest;
+
+        const char* sql = R"(
+            INSERT INTO feedback_revisions (candidate_id, revision, is_delta, codec, size, text_size, body)
+            SELECT candidate_id, 1, 0, codec, size, size, body FROM candidate_feedback WHERE candidate_id = ?
+        )";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return sqlite3_changes(db) > 0 ? 1 : 0;
+    }
+
+    // Appends feedback as the candidate's next revision, as a delta against
+    // the current text unless a snapshot is due. Part of the caller's
+    // transaction, before candidate_feedback is overwritten.
+    void add_feedback_revision(const std::string& candidate_id, const std::string& feedback) {
+        int revision = begin_feedback_history(candidate_id) + 1;
+        if (revision == 1 && feedback.empty()) return;
+
+        bool snapshot = (revision - 1) % feedback_snapshot_every == 0;
+        std::string body;
+        if (!snapshot) {
+            sqlite3_stmt* stmt;
+            sqlite3_prepare_v2(db, "SELECT codec, size, body FROM candidate_feedback WHERE candidate_id = ?",
+                               -1, &stmt, nullptr);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+            std::string previous;
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                // Streamed documents are too big to diff in memory
+                snapshot = static_cast<size_t>(sqlite3_column_int64(stmt, 1)) > feedback_inline_max ||
+                           !unpack_text(sqlite3_column_int(stmt, 0), sqlite3_column_blob(stmt, 2),
+                                        sqlite3_column_bytes(stmt, 2), sqlite3_column_int64(stmt, 1), previous);
+            }
+            sqlite3_finalize(stmt);
+            if (!snapshot) body = make_delta(previous, feedback);
+            // A rewrite from scratch is no smaller as a delta
+            snapshot = snapshot || body.size() >= feedback.size();
+        }
+        if (snapshot) body = feedback;
+
+        const char* sql = R"(
+            INSERT INTO feedback_revisions (candidate_id, revision, is_delta, text_size, codec, size, body)
+            VALUES (?, ?, ?, ?, ?, ?, ?)
+        )";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, revision);
+        sqlite3_bind_int(stmt, 3, snapshot ? 0 : 1);
+        sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(feedback.size()));
+        std::string packed;
+        bind_feedback(stmt, 5, body, packed);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    // Every save is kept in feedback_revisions as well; see add_feedback_revision
+    void update_feedback(const std::string& candidate_id, const std::string& feedback) {
+        TRACE_SCOPE("db.update_feedback");
+        Transaction txn(db);
+        sqlite3_stmt* stmt;
+        std::string packed;
+        add_feedback_revision(candidate_id, feedback);
+        if (feedback.empty()) {
+            // Empty feedback removes the candidate's feedback row
+            sqlite3_prepare_v2(db, "DELETE FROM candidate_feedback WHERE candidate_id = ?", -1, &stmt, nullptr);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        } else {
+            const char* sql = R"(
+                INSERT INTO candidate_feedback (candidate_id, codec, size, body) VALUES (?, ?, ?, ?)
+                ON CONFLICT (candidate_id) DO UPDATE SET
+                    codec = excluded.codec, size = excluded.size, body = excluded.body
+            )";
+            sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+            bind_feedback(stmt, 2, feedback, packed);
+        }
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        const char* sql = "UPDATE candidate_search SET student_feedback = ? WHERE rowid = (SELECT rowid FROM candidates WHERE id = ?)";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, feedback.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        txn.commit();
+    }
+
+    // Copies the first bytes of one blob column into another, a piece at a
+    // time, so neither is ever loaded whole
+    bool copy_blob(const char* from_table, sqlite3_int64 from_row, const char* to_table, sqlite3_int64 to_row,
+                   size_t bytes) {
+        sqlite3_blob* from = nullptr;
+        sqlite3_blob* to = nullptr;
+        bool ok = sqlite3_blob_open(db, "main", from_table, "body", from_row, 0, &from) == SQLITE_OK &&
+                  sqlite3_blob_open(db, "main", to_table, "body", to_row, 1, &to) == SQLITE_OK;
+        char buf[64 * 1024];
+        for (size_t offset = 0; ok && offset < bytes; offset += sizeof(buf)) {
+            int n = static_cast<int>(std::min(sizeof(buf), bytes - offset));
+            ok = sqlite3_blob_read(from, buf, n, static_cast<int>(offset)) == SQLITE_OK &&
+                 sqlite3_blob_write(to, buf, n, static_cast<int>(offset)) == SQLITE_OK;
+        }
+        sqlite3_blob_close(from);
+        sqlite3_blob_close(to);
+        return ok;
+    }
+
+    // Streamed uploads (FeedbackUpload in feedback.h) are written into a
+    // feedback_uploads row of a fixed capacity, one short transaction per
+    // chunk, so other requests are never held up for the whole upload and
+    // readers never see a half-written document. Returns the row, or 0.
+    sqlite3_int64 begin_feedback_upload(const std::string& candidate_id, size_t capacity) {
+        TRACE_SCOPE("db.begin_feedback_upload");
+        Transaction txn(db);
+        const char* sql = "INSERT INTO feedback_uploads (candidate_id, body) VALUES (?, zeroblob(?))";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(capacity));
+        bool inserted = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        sqlite3_int64 upload = inserted ? sqlite3_last_insert_rowid(db) : 0;
+        return txn.commit() ? upload : 0;
+    }
+
+    bool write_feedback_upload(sqlite3_int64 upload, size_t offset, const char* data, size_t len) {
+        TRACE_SCOPE("db.write_feedback_upload");
+        Transaction txn(db);
+        sqlite3_blob* blob;
+        if (sqlite3_blob_open(db, "main", "feedback_uploads", "body", upload, 1, &blob) != SQLITE_OK) {
+            sqlite3_blob_close(blob);
+            return false;
+        }
+        bool ok = sqlite3_blob_write(blob, data, static_cast<int>(len), static_cast<int>(offset)) == SQLITE_OK;
+        sqlite3_blob_close(blob);
+        return ok && txn.commit();
+    }
+
+    // Replaces the candidate's feedback with the first stored bytes of the
+    // upload, blob to blob in fixed-size pieces, and drops the staging row.
+    // search_text is what the search index gets (a prefix of long documents).
+    bool finish_feedback_upload(sqlite3_int64 upload, const std::string& candidate_id, int codec, size_t size,
+                                size_t stored, const std::string& search_text) {
+        TRACE_SCOPE("db.finish_feedback_upload");
+        Transaction txn(db);
+        int revision = begin_feedback_history(candidate_id) + 1;
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "DELETE FROM candidate_feedback WHERE candidate_id = ?", -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        const char* sql = "INSERT INTO candidate_feedback (candidate_id, codec, size, body) VALUES (?, ?, ?, zeroblob(?))";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, codec);
+        sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(size));
+        sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(stored));
+        bool inserted = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!inserted) return false;
+        if (!copy_blob("feedback_uploads", upload, "candidate_feedback", sqlite3_last_insert_rowid(db), stored)) {
+            return false;
+        }
+
+        // A streamed document is kept whole as a snapshot; diffing it would
+        // mean holding both versions in memory
+        sql = R"(
+            INSERT INTO feedback_revisions (candidate_id, revision, is_delta, codec, size, text_size, body)
+            VALUES (?, ?, 0, ?, ?, ?, zeroblob(?))
+        )";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, revision);
+        sqlite3_bind_int(stmt, 3, codec);
+        sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(size));
+        sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(size));
+        sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(stored));
+        inserted = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!inserted ||
+            !copy_blob("feedback_uploads", upload, "feedback_revisions", sqlite3_last_insert_rowid(db), stored)) {
+            return false;
+        }
+
+        sqlite3_prepare_v2(db, "DELETE FROM feedback_uploads WHERE id = ?", -1, &stmt, nullptr);
+        sqlite3_bind_int64(stmt, 1, upload);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        sql = "UPDATE candidate_search SET student_feedback = ? WHERE rowid = (SELECT rowid FROM candidates WHERE id = ?)";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, search_text.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return txn.commit();
+    }
+
+    void cancel_feedback_upload(sqlite3_int64 upload) {
+        TRACE_SCOPE("db.cancel_feedback_upload");
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "DELETE FROM feedback_uploads WHERE id = ?", -1, &stmt, nullptr);
+        sqlite3_bind_int64(stmt, 1, upload);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    // Calls fn(const FeedbackRevisionView&) for each saved version of the
+    // candidate's feedback, oldest first
+    template <typename Fn>
+    void for_each_feedback_revision(const std::string& candidate_id, Fn&& fn) {
+        TRACE_SCOPE("db.for_each_feedback_revision");
+        const char* sql = R"(
+            SELECT revision, is_delta, text_size, length(body), created_at
+            FROM feedback_revisions
+            WHERE candidate_id = ?
+            ORDER BY revision
+        )";
+        auto list = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+            int rows = 0;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                rows++;
+                fn(FeedbackRevisionView{sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1) != 0,
+                                        sqlite3_column_int64(stmt, 2), sqlite3_column_int64(stmt, 3),
+                                        column_view(stmt, 4)});
+            }
+            return rows;
+        };
+        if (list(sql) == 0 && has_archive) list(archived(sql));
+    }
+
+    // Text of one revision: the nearest snapshot at or before it, then each
+    // delta after that in turn (fewer than feedback_snapshot_every)
+    bool get_feedback_revision(const std::string& candidate_id, int revision, std::string& text) {
+        TRACE_SCOPE("db.get_feedback_revision");
+        const char* sql = R"(
+            SELECT revision, is_delta, codec, size, body
+            FROM feedback_revisions
+            WHERE candidate_id = ?1 AND revision <= ?2
+              AND revision >= (SELECT MAX(revision) FROM feedback_revisions
+                               WHERE candidate_id = ?1 AND revision <= ?2 AND is_delta = 0)
+            ORDER BY revision
+        )";
+        auto rebuild = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 2, revision);
+            int last = 0;
+            bool ok = true;
+            std::string body, next;
+            text.clear();
+            while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+                last = sqlite3_column_int(stmt, 0);
+                ok = unpack_text(sqlite3_column_int(stmt, 2), sqlite3_column_blob(stmt, 4),
+                                 sqlite3_column_bytes(stmt, 4), sqlite3_column_int64(stmt, 3), body);
+                if (!ok) break;
+                if (sqlite3_column_int(stmt, 1)) {
+                    ok = apply_delta(text, body, next);
+                    text.swap(next);
+                } else {
+                    text.swap(body);
+                }
+            }
+            // No rows: an unknown candidate, or revision 0
+            return ok && last > 0 && last == revision;
+        };
+        return rebuild(sql) || (has_archive && rebuild(archived(sql)));
+    }
+
+    // Calls fn(const SearchHitView&) for the best limit matches by BM25.
+    // Name matches weigh most, then the position title, then feedback.
+    //
+    // Scoring is what costs: bm25() has to visit every matching row, and a
+    // common word can match most of the table. Only the newest
+    // search_scan_limit matches are scored, so the cost of a query is bounded
+    // no matter how many rows match. The rows returned are then read by
+    // rowid and highlighted in search.h.
+    static constexpr int search_scan_limit = 1000;
+    static constexpr size_t search_snippet_words = 16;
+
+    template <typename Fn>
+    void search_candidates(const std::string& text, int limit, Fn&& fn) {
+        TRACE_SCOPE("db.search_candidates");
+        std::vector<std::string> words = search_words(text);
+        if (words.empty()) return;
+        std::string query = search_query(words);
+
+        std::vector<std::pair<sqlite3_int64, double>> hits;
+        const char* sql = R"(
+            SELECT rowid, score FROM (
+                SELECT rowid, bm25(candidate_search, 10.0, 4.0, 1.0) AS score
+                FROM candidate_search
+                WHERE candidate_search MATCH ?
+                ORDER BY rowid DESC
+                LIMIT ?
+            )
+            ORDER BY score
+            LIMIT ?
+        )";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, search_scan_limit);
+        sqlite3_bind_int(stmt, 3, limit);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            hits.emplace_back(sqlite3_column_int64(stmt, 0), sqlite3_column_double(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+
+        // Candidates deleted since they were indexed find no row here. The
+        // snippet comes from the indexed feedback, which for a streamed
+        // upload is only the start of the document (see feedback.h).
+        sql = R"(
+            SELECT c.id, p.id, p.title, c.name, s.student_feedback
+            FROM candidates c
+            JOIN positions p ON p.id = c.position_id
+            JOIN candidate_search s ON s.rowid = c.rowid
+            WHERE c.rowid = ?
+        )";
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        for (const auto& hit : hits) {
+            sqlite3_bind_int64(stmt, 1, hit.first);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                std::string title = mark_matches(column_view(stmt, 2), words);
+                std::string name = mark_matches(column_view(stmt, 3), words);
+                std::string snippet = match_snippet(column_view(stmt, 4), words, search_snippet_words);
+                fn(SearchHitView{column_view(stmt, 0), column_view(stmt, 1), title, name, snippet, hit.second});
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // Calls fn(const ScoreView&) for each interviewer's score on the candidate
+    template <typename Fn>
+    void for_each_score(const std::string& candidate_id, Fn&& fn) {
+        TRACE_SCOPE("db.for_each_score");
+        const char* sql = R"(
+            SELECT s.interviewer_id, u.display_name, s.hand_gestures, s.stayed_awake, s.updated_at
+            FROM scores s
+            JOIN users u ON u.id = s.interviewer_id
+            WHERE s.candidate_id = ?
+            ORDER BY s.updated_at DESC, s.interviewer_id
+        )";
+        auto list = [&](const char* query) {
+            Statement stmt(*this, query);
+            sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+            int rows = 0;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                rows++;
+                fn(ScoreView{column_view(stmt, 0), column_view(stmt, 1), sqlite3_column_int(stmt, 2),
+                             sqlite3_column_int(stmt, 3), column_view(stmt, 4)});
+            }
+            return rows;
+        };
+        if (list(sql) == 0 && has_archive) list(archived(sql));
+    }
+
+    struct PageStats {
+        long long page_size = 0;
+        long long pages = 0;
+        long long free_pages = 0;
+        bool incremental = false;   // free pages can be released a few at a time
+    };
+
+    // Size of schema ("main" or "archive") and how much of it is unused
+    PageStats page_stats(const std::string& schema) {
+        PageStats stats;
+        stats.page_size = pragma_int(schema + ".page_size");
+        stats.pages = pragma_int(schema + ".page_count");
+        stats.free_pages = pragma_int(schema + ".freelist_count");
+        stats.incremental = pragma_int(schema + ".auto_vacuum") == incremental_auto_vacuum;
+        return stats;
+    }
+
+    // Hands up to pages free pages at the end of schema back to the file
+    // system, first moving pages from the end of the file into the gaps
+    void incremental_vacuum(const std::string& schema, int pages) {
+        TRACE_SCOPE("db.incremental_vacuum");
+        std::string sql = "PRAGMA " + schema + ".incremental_vacuum(" + std::to_string(pages) + ")";
+        sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr);
+    }
+
+    // Rows written so far through this connection, by any thread
+    long long total_changes() { return sqlite3_total_changes64(db); }
+
+    // Stops a position taking candidates, scores and feedback, and queues it
+    // for the archive. Only its creator may. False if user_id has no such
+    // open position.
+    bool close_position(const std::string& id, const std::string& user_id) {
+        TRACE_SCOPE("db.close_position");
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, R"(
+            UPDATE positions SET closed_at = datetime('now')
+            WHERE id = ? AND created_by = ? AND closed_at IS NULL
+            RETURNING id
+        )", -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, user_id.c_str(), -1, SQLITE_TRANSIENT);
+        bool closed = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return closed;
+    }
+
+    // Closed positions not yet gone from the hot tables
+    bool has_closed_positions() {
+        Statement closed(*this, "SELECT 1 FROM positions WHERE closed_at IS NOT NULL LIMIT 1");
+        return sqlite3_step(closed) == SQLITE_ROW;
+    }
+
+    struct ArchiveStep {
+        std::string position_id;
+        int copied = 0;             // candidates
+        int scores = 0;
+        int removed = 0;            // hot candidates
+        bool switched = false;      // reads went over to the archive
+        bool finished = false;      // the hot rows are all gone
+    };
+
+    // One short transaction of archiving on the position closed longest
+    // (and at least a minute ago, so writes that passed a closed check just
+    // before it have landed):
+    //   1. copy up to limit of its candidates, with their scores, feedback
+    //      and revisions, into the archive
+    //   2. once all are copied, copy the position and set its archived_at,
+    //      which sends reads to the archive (whose copy keeps archived_at
+    //      NULL, as the fallback queries expect)
+    //   3. delete up to limit of its hot candidates with their scores,
+    //      cascading to the rest, and at last the position. None of it is
+    //      logged as a delete (see create_triggers): followers keep the
+    //      position, and get_changes reads it from the archive.
+    // In WAL mode the two databases commit separately; every phase can be
+    // repeated, so a crash between them only redoes work. False when there
+    // is nothing to archive.
+    bool archive_step(int limit, ArchiveStep& step) {
+        TRACE_SCOPE("db.archive_step");
+        if (!has_archive || replica) return false;
+        Transaction txn(db);
+        step = ArchiveStep();
+        bool switched;
+        {
+            Statement pick(*this, R"(
+                SELECT id, archived_at IS NOT NULL FROM positions
+                WHERE closed_at <= datetime('now', '-1 minute')
+                ORDER BY archived_at IS NULL, closed_at
+                LIMIT 1
+            )");
+            if (sqlite3_step(pick) != SQLITE_ROW) return false;
+            step.position_id = column_string(pick, 0);
+            switched = sqlite3_column_int(pick, 1) != 0;
+        }
+
+        // ?1 is the position, ?2 the limit; returns rows changed
+        auto run = [&](const char* sql) {
+            Statement stmt(*this, sql);
+            sqlite3_bind_text(stmt, 1, step.position_id.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_bind_parameter_count(stmt) > 1) sqlite3_bind_int(stmt, 2, limit);
+            return sqlite3_step(stmt) == SQLITE_DONE ? sqlite3_changes(db) : -1;
+        };
+        if (!switched) {
+            run(R"(
+                INSERT INTO temp.archive_batch
+                SELECT id FROM main.candidates c
+                WHERE position_id = ?1 AND NOT EXISTS (SELECT 1 FROM archive.candidates a WHERE a.id = c.id)
+                LIMIT ?2
+            )");
+            step.copied = run("INSERT OR REPLACE INTO archive.candidates SELECT * FROM main.candidates WHERE id IN temp.archive_batch");
+            if (step.copied > 0) {
+                step.scores = run("INSERT OR REPLACE INTO archive.scores SELECT * FROM main.scores WHERE candidate_id IN temp.archive_batch");
+                run("INSERT OR REPLACE INTO archive.candidate_feedback SELECT * FROM main.candidate_feedback WHERE candidate_id IN temp.archive_batch");
+                run("INSERT OR REPLACE INTO archive.feedback_revisions SELECT * FROM main.feedback_revisions WHERE candidate_id IN temp.archive_batch");
+            } else if (step.copied == 0) {
+                run("INSERT OR REPLACE INTO archive.positions SELECT * FROM main.positions WHERE id = ?1");
+                run("UPDATE main.positions SET archived_at = datetime('now') WHERE id = ?1");
+                step.switched = true;
+            }
+        } else {
+            run("INSERT INTO temp.archive_batch SELECT id FROM main.candidates WHERE position_id = ?1 LIMIT ?2");
+            run("DELETE FROM candidate_search WHERE rowid IN (SELECT rowid FROM main.candidates WHERE id IN temp.archive_batch)");
+            run("DELETE FROM main.scores WHERE candidate_id IN temp.archive_batch");
+            step.removed = run("DELETE FROM main.candidates WHERE id IN temp.archive_batch");
+            if (step.removed == 0) step.finished = run("DELETE FROM main.positions WHERE id = ?1") == 1;
+        }
+        run("DELETE FROM temp.archive_batch");
+        return step.copied >= 0 && step.removed >= 0 && txn.commit();
+    }
+
+    // Current state of everything changed after version since, at most limit
+    // change-log entries. The four reads share one transaction so the result
+    // is a consistent snapshot.
+    void get_changes(int64_t since, int limit, ChangeSet& changes) {
+        TRACE_SCOPE("db.get_changes");
+        Transaction txn(db, Transaction::Deferred);
+
+        // Upper bound of this batch: the limit-th version after since
+        int64_t upto = INT64_MAX;
+        {
+            Statement stmt(*this, "SELECT version FROM change_log WHERE version > ? ORDER BY version LIMIT 2 OFFSET ?");
+            sqlite3_bind_int64(stmt, 1, since);
+            sqlite3_bind_int(stmt, 2, limit - 1);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                upto = sqlite3_column_int64(stmt, 0);
+                changes.more = sqlite3_step(stmt) == SQLITE_ROW;
+            }
+        }
+        {
+            Statement stmt(*this, "SELECT MAX(version) FROM change_log WHERE version > ?1 AND version <= ?2");
+            sqlite3_bind_int64(stmt, 1, since);
+            sqlite3_bind_int64(stmt, 2, upto);
+            sqlite3_step(stmt);
+            changes.version = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? since : sqlite3_column_int64(stmt, 0);
+        }
+        {
+            Statement stmt(*this, "SELECT MAX(version) FROM change_log");
+            sqlite3_step(stmt);
+            changes.latest = std::max(changes.version, static_cast<int64_t>(sqlite3_column_int64(stmt, 0)));
+        }
+        if (changes.version == since) return;
+
+        // Rows archive_step has moved out of the hot tables are read from the
+        // archive (?3 = 1), so a follower starting from scratch still gets them
+        auto read = [&](const char* sql, bool archive, auto&& add) {
+            for (int cold = 0; cold <= (archive && has_archive ? 1 : 0); cold++) {
+                Statement stmt(*this, cold ? archived(sql) : sql);
+                sqlite3_bind_int64(stmt, 1, since);
+                sqlite3_bind_int64(stmt, 2, changes.version);
+                if (archive) sqlite3_bind_int(stmt, 3, cold);
+                while (sqlite3_step(stmt) == SQLITE_ROW) add(stmt);
+            }
+        };
+
+        read(R"(
+            SELECT u.id, u.email, u.display_name, u.created_at
+            FROM change_log c JOIN users u ON u.id = c.entity_id
+            WHERE c.version > ?1 AND c.version <= ?2 AND c.entity = 'user' AND c.op = 'upsert'
+            ORDER BY c.version
+        )", false, [&](sqlite3_stmt* stmt) {
+            changes.users.push_back({column_string(stmt, 0), column_string(stmt, 1), column_string(stmt, 2),
+                                     column_string(stmt, 3)});
+        });
+
+        read(R"(
+            SELECT p.id, p.title, p.created_by, p.created_at, p.candidate_count
+            FROM change_log c JOIN positions p ON p.id = c.entity_id
+            WHERE c.version > ?1 AND c.version <= ?2 AND c.entity = 'position' AND c.op = 'upsert'
+              AND (?3 = 0 OR NOT EXISTS (SELECT 1 FROM main.positions m WHERE m.id = c.entity_id))
+            ORDER BY c.version
+        )", true, [&](sqlite3_stmt* stmt) {
+            changes.positions.push_back({column_string(stmt, 0), column_string(stmt, 1), column_string(stmt, 2),
+                                         column_string(stmt, 3), sqlite3_column_int(stmt, 4)});
+        });
+
+        read(R"(
+            SELECT cd.id, cd.position_id, cd.name, unpack_text(f.codec, f.size, f.body), cd.created_at
+            FROM change_log c JOIN candidates cd ON cd.id = c.entity_id
+            LEFT JOIN candidate_feedback f ON f.candidate_id = cd.id
+            WHERE c.version > ?1 AND c.version <= ?2 AND c.entity = 'candidate' AND c.op = 'upsert'
+              AND (?3 = 0 OR NOT EXISTS (SELECT 1 FROM main.candidates m WHERE m.id = c.entity_id))
+            ORDER BY c.version
+        )", true, [&](sqlite3_stmt* stmt) {
+            changes.candidates.push_back({column_string(stmt, 0), column_string(stmt, 1), column_string(stmt, 2),
+                                          column_string(stmt, 3), column_string(stmt, 4)});
+        });
+
+        read(R"(
+            SELECT s.id, s.candidate_id, s.interviewer_id, s.hand_gestures, s.stayed_awake, s.updated_at
+            FROM change_log c JOIN scores s ON s.id = c.entity_id
+            WHERE c.version > ?1 AND c.version <= ?2 AND c.entity = 'score' AND c.op = 'upsert'
+              AND (?3 = 0 OR NOT EXISTS (SELECT 1 FROM main.scores m WHERE m.id = c.entity_id))
+            ORDER BY c.version
+        )", true, [&](sqlite3_stmt* stmt) {
+            changes.scores.push_back({column_string(stmt, 0), column_string(stmt, 1), column_string(stmt, 2),
+                                      sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4),
+                                      column_string(stmt, 5)});
+        });
+
+        read(R"(
+            SELECT entity, entity_id FROM change_log
+            WHERE version > ?1 AND version <= ?2 AND op = 'delete'
+            ORDER BY version
+        )", false, [&](sqlite3_stmt* stmt) {
+            changes.deleted.push_back({column_string(stmt, 0), column_string(stmt, 1)});
+        });
+        txn.commit();
+    }
+
+    // Version of source's change log applied so far (0 if none)
+    int64_t replication_version(const std::string& source) {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "SELECT version FROM replication_state WHERE source = ?", -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, source.c_str(), -1, SQLITE_TRANSIENT);
+        int64_t version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        return version;
+    }
+
+    // Applies one page of source's /api/changes and records its version, in
+    // one transaction. Adds the positions whose rankings may have changed to
+    // positions.
+    //
+    // Pages follow the primary's log order, not dependency order: a position
+    // is re-logged after its candidates whenever candidate_count changes, so
+    // a candidate can arrive a page before its position. Foreign keys are
+    // off while applying; the primary logs a delete for every cascaded row,
+    // and candidate_count is taken from the primary rather than counted.
+    bool apply_changes(const std::string& source, const ChangeSet& changes, std::vector<std::string>& positions) {
+        TRACE_SCOPE("db.apply_changes");
+        sqlite3_mutex* conn = sqlite3_db_mutex(db);
+        sqlite3_mutex_enter(conn);
+        sqlite3_exec(db, "PRAGMA foreign_keys = OFF", nullptr, nullptr, nullptr);
+        bool ok = apply_changes_unchecked(source, changes, positions);
+        sqlite3_exec(db, "PRAGMA foreign_keys = ON", nullptr, nullptr, nullptr);
+        sqlite3_mutex_leave(conn);
+        return ok;
+    }
+
+private:
+    // Runs sql once per set of bindings; each bind(stmt) call binds one row
+    template <typename Rows, typename Bind>
+    void exec_each(const char* sql, const Rows& rows, Bind&& bind) {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        for (const auto& row : rows) {
+            bind(stmt, row);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    static void bind_string(sqlite3_stmt* stmt, int index, const std::string& s) {
+        sqlite3_bind_text(stmt, index, s.c_str(), static_cast<int>(s.size()), SQLITE_STATIC);
+    }
+
+    bool apply_changes_unchecked(const std::string& source, const ChangeSet& changes,
+                                 std::vector<std::string>& positions) {
+        Transaction txn(db);
+        const char* unindex_sql = "DELETE FROM candidate_search WHERE rowid = (SELECT rowid FROM candidates WHERE id = ?)";
+
+        // Deletes first: they free UNIQUE keys (a re-scored candidate's new
+        // score row) and decrement counts the position rows below then set
+        static const char* const entities[] = {"score", "candidate", "position", "user"};
+        static const char* const deletes[] = {"DELETE FROM scores WHERE id = ?", "DELETE FROM candidates WHERE id = ?",
+                                              "DELETE FROM positions WHERE id = ?", "DELETE FROM users WHERE id = ?"};
+        std::vector<std::string> deleted[4];
+        for (const DeletedEntity& d : changes.deleted) {
+            for (int i = 0; i < 4; i++) {
+                if (d.entity == entities[i]) deleted[i].push_back(d.id);
+            }
+        }
+        auto bind_id = [](sqlite3_stmt* stmt, const std::string& id) { bind_string(stmt, 1, id); };
+        exec_each(unindex_sql, deleted[1], bind_id);
+        exec_each("DELETE FROM candidate_feedback WHERE candidate_id = ?", deleted[1], bind_id);
+        exec_each("DELETE FROM feedback_revisions WHERE candidate_id = ?", deleted[1], bind_id);
+        for (int i = 0; i < 4; i++) exec_each(deletes[i], deleted[i], bind_id);
+
+        exec_each(R"(
+            INSERT INTO users (id, email, display_name, created_at) VALUES (?, ?, ?, ?)
+            ON CONFLICT (id) DO UPDATE SET email = excluded.email, display_name = excluded.display_name
+        )", changes.users, [](sqlite3_stmt* stmt, const ChangedUser& u) {
+            bind_string(stmt, 1, u.id);
+            bind_string(stmt, 2, u.email);
+            bind_string(stmt, 3, u.display_name);
+            bind_string(stmt, 4, u.created_at);
+        });
+
+        auto bind_candidate = [](sqlite3_stmt* stmt, const ChangedCandidate& c) { bind_string(stmt, 1, c.id); };
+        exec_each(unindex_sql, changes.candidates, bind_candidate);
+        exec_each(R"(
+            INSERT INTO candidates (id, position_id, name, created_at) VALUES (?, ?, ?, ?)
+            ON CONFLICT (id) DO UPDATE SET position_id = excluded.position_id, name = excluded.name
+        )", changes.candidates, [](sqlite3_stmt* stmt, const ChangedCandidate& c) {
+            bind_string(stmt, 1, c.id);
+            bind_string(stmt, 2, c.position_id);
+            bind_string(stmt, 3, c.name);
+            bind_string(stmt, 4, c.created_at);
+        });
+        std::vector<const ChangedCandidate*> with_feedback;
+        std::vector<std::string> without_feedback;
+        for (const ChangedCandidate& c : changes.candidates) {
+            if (c.student_feedback.empty()) {
+                without_feedback.push_back(c.id);
+            } else {
+                with_feedback.push_back(&c);
+            }
+        }
+        std::string packed;
+        exec_each(R"(
+            INSERT INTO candidate_feedback (candidate_id, codec, size, body) VALUES (?, ?, ?, ?)
+            ON CONFLICT (candidate_id) DO UPDATE SET codec = excluded.codec, size = excluded.size, body = excluded.body
+        )", with_feedback, [&](sqlite3_stmt* stmt, const ChangedCandidate* c) {
+            bind_string(stmt, 1, c->id);
+            bind_feedback(stmt, 2, c->student_feedback, packed);
+        });
+        exec_each("DELETE FROM candidate_feedback WHERE candidate_id = ?", without_feedback, bind_id);
+
+        exec_each(R"(
+            INSERT INTO scores (id, candidate_id, interviewer_id, hand_gestures, stayed_awake, created_at, updated_at)
+            VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?6)
+            ON CONFLICT (id) DO UPDATE SET
+                hand_gestures = excluded.hand_gestures, stayed_awake = excluded.stayed_awake,
+                updated_at = excluded.updated_at
+        )", changes.scores, [](sqlite3_stmt* stmt, const ChangedScore& sc) {
+            bind_string(stmt, 1, sc.id);
+            bind_string(stmt, 2, sc.candidate_id);
+            bind_string(stmt, 3, sc.interviewer_id);
+            sqlite3_bind_int(stmt, 4, sc.hand_gestures);
+            sqlite3_bind_int(stmt, 5, sc.stayed_awake);
+            bind_string(stmt, 6, sc.updated_at);
+        });
+
+        exec_each(R"(
+            INSERT INTO positions (id, title, created_by, created_at, candidate_count) VALUES (?, ?, ?, ?, ?)
+            ON CONFLICT (id) DO UPDATE SET
+                title = excluded.title, created_by = excluded.created_by, candidate_count = excluded.candidate_count
+        )", changes.positions, [](sqlite3_stmt* stmt, const ChangedPosition& p) {
+            bind_string(stmt, 1, p.id);
+            bind_string(stmt, 2, p.title);
+            bind_string(stmt, 3, p.created_by);
+            bind_string(stmt, 4, p.created_at);
+            sqlite3_bind_int(stmt, 5, p.candidate_count);
+        });
+
+        // Index the candidates now that their positions may have arrived,
+        // including any from earlier pages that were waiting on one
+        exec_each(index_candidate_sql, changes.candidates, bind_candidate);
+        exec_each(R"(
+            INSERT INTO candidate_search (rowid, name, position_title, student_feedback)
+            SELECT c.rowid, c.name, p.title, COALESCE(unpack_text(f.codec, f.size, f.body), '')
+            FROM candidates c
+            JOIN positions p ON p.id = c.position_id
+            LEFT JOIN candidate_feedback f ON f.candidate_id = c.id
+            WHERE c.position_id = ? AND NOT EXISTS (SELECT 1 FROM candidate_search s WHERE s.rowid = c.rowid)
+        )", changes.positions, [](sqlite3_stmt* stmt, const ChangedPosition& p) {
+            bind_string(stmt, 1, p.id);
+        });
+
+        for (const ChangedPosition& p : changes.positions) positions.push_back(p.id);
+        for (const ChangedCandidate& c : changes.candidates) positions.push_back(c.position_id);
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, "SELECT position_id FROM candidates WHERE id = ?", -1, &stmt, nullptr);
+        for (const ChangedScore& sc : changes.scores) {
+            bind_string(stmt, 1, sc.candidate_id);
+            if (sqlite3_step(stmt) == SQLITE_ROW) positions.push_back(column_string(stmt, 0));
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+
+        sqlite3_prepare_v2(db, R"(
+            INSERT INTO replication_state (source, version) VALUES (?, ?)
+            ON CONFLICT (source) DO UPDATE SET version = excluded.version
+        )", -1, &stmt, nullptr);
+        bind_string(stmt, 1, source);
+        sqlite3_bind_int64(stmt, 2, changes.version);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return txn.commit();
+    }
+
+    sqlite3_stmt* borrow(const char* sql) {
+        {
+            std::lock_guard<std::mutex> lock(statements_mutex_);
+            auto it = idle_statements_.find(sql);
+            if (it != idle_statements_.end()) {
+                sqlite3_stmt* stmt = it->second;
+                idle_statements_.erase(it);
+                statements_reused_++;
+                return stmt;
+            }
+        }
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+        statements_prepared_++;
+        return stmt;
+    }
+
+    void give_back(const char* sql, sqlite3_stmt* stmt) {
+        if (!stmt) return;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        std::lock_guard<std::mutex> lock(statements_mutex_);
+        idle_statements_.emplace(sql, stmt);
+    }
+
+    std::mutex statements_mutex_;
+    std::unordered_multimap<const char*, sqlite3_stmt*> idle_statements_;
+    std::unordered_map<const char*, std::string> archived_sql_;
+    std::atomic<size_t> statements_prepared_{0};
+    std::atomic<size_t> statements_reused_{0};
+};
+
+#endif // DATABASE_H
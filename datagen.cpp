@@ -0,0 +1,313 @@
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "database.h"
+#include "bench_util.h"
+
+// Synthetic dataset generator for scale testing.
+//
+//   ./datagen --db scale.db --users 2000 --positions 100000
+//             --candidates-per-position 50 --scores-per-candidate 10 --feedback-bytes 2000
+//
+// Rows are inserted with one prepared statement per table, reused across the
+// whole run, inside large transactions (--batch rows each). Journaling and
+// fsync are relaxed for the load, and the secondary indexes are dropped and
+// rebuilt in one sorted pass at the end (--keep-indexes to skip that). The
+// candidate_count and change-log triggers are off during the load; both are
+// brought up to date afterwards in one statement each. The file is only
+// usable once datagen exits.
+
+struct Options {
+    std::string db_path;
+    long users;
+    long positions;
+    long candidates_per_position;
+    long scores_per_candidate;
+    long feedback_bytes;
+    double feedback_ratio;
+    long batch;
+    int years;
+    unsigned seed;
+    bool keep_indexes;
+};
+
+class Generator {
+public:
+    Generator(sqlite3* db, const Options& opt) : db_(db), opt_(opt), rng_(opt.seed) {}
+
+    ~Generator() {
+        for (sqlite3_stmt* stmt : {user_stmt_, position_stmt_, candidate_stmt_, feedback_stmt_, score_stmt_}) {
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    void run() {
+        prepare();
+        begin();
+
+        std::vector<std::string> user_ids;
+        user_ids.reserve(opt_.users);
+        for (long u = 0; u < opt_.users; u++) {
+            std::string id = "gen-user-" + std::to_string(u);
+            bind(user_stmt_, 1, id);
+            bind(user_stmt_, 2, id + "@university.edu");
+            bind(user_stmt_, 3, "Interviewer " + std::to_string(u));
+            step(user_stmt_);
+            user_ids.push_back(id);
+        }
+        report("users", opt_.users);
+
+        // Spread creation times evenly over the last --years years
+        std::time_t end = std::time(nullptr);
+        std::time_t begin_time = end - static_cast<std::time_t>(opt_.years) * 365 * 24 * 3600;
+        double step_seconds = opt_.positions > 0 ? double(end - begin_time) / opt_.positions : 0;
+
+        long scores_per_candidate = std::min(opt_.scores_per_candidate, opt_.users);
+        std::uniform_int_distribution<long> pick_user(0, opt_.users - 1);
+        std::uniform_int_distribution<int> pick_score(1, 5);
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        std::string feedback, packed;
+
+        for (long p = 0; p < opt_.positions; p++) {
+            std::string position_id = uuid();
+            std::string created = timestamp(begin_time + static_cast<std::time_t>(p * step_seconds));
+            bind(position_stmt_, 1, position_id);
+            bind(position_stmt_, 2, "Position " + std::to_string(p) + " - " + department(p));
+            bind(position_stmt_, 3, user_ids[pick_user(rng_)]);
+            bind(position_stmt_, 4, created);
+            step(position_stmt_);
+
+            for (long c = 0; c < opt_.candidates_per_position; c++) {
+                std::string candidate_id = uuid();
+                bind(candidate_stmt_, 1, candidate_id);
+                bind(candidate_stmt_, 2, position_id);
+                bind(candidate_stmt_, 3, "Candidate " + std::to_string(p) + "-" + std::to_string(c));
+                bind(candidate_stmt_, 4, created);
+                step(candidate_stmt_);
+                candidates_++;
+
+                if (opt_.feedback_bytes > 0 && chance(rng_) < opt_.feedback_ratio) {
+                    fill_feedback(feedback);
+                    bind(feedback_stmt_, 1, candidate_id);
+                    Database::bind_feedback(feedback_stmt_, 2, feedback, packed);
+                    step(feedback_stmt_);
+                }
+
+                // Consecutive interviewers from a random start are distinct,
+                // which keeps UNIQUE (candidate_id, interviewer_id) satisfied.
+                long first = opt_.users > 0 ? pick_user(rng_) : 0;
+                for (long s = 0; s < scores_per_candidate; s++) {
+                    bind(score_stmt_, 1, uuid());
+                    bind(score_stmt_, 2, candidate_id);
+                    bind(score_stmt_, 3, user_ids[(first + s) % opt_.users]);
+                    sqlite3_bind_int(score_stmt_, 4, pick_score(rng_));
+                    sqlite3_bind_int(score_stmt_, 5, pick_score(rng_));
+                    bind(score_stmt_, 6, created);
+                    step(score_stmt_);
+                    scores_++;
+                }
+            }
+            positions_++;
+
+            if (rows_in_batch_ >= opt_.batch) {
+                commit();
+                begin();
+            }
+            if ((p + 1) % 1000 == 0) report("positions", p + 1);
+        }
+        commit();
+        report("positions", opt_.positions);
+    }
+
+    long positions_ = 0;
+    long candidates_ = 0;
+    long scores_ = 0;
+
+private:
+    void prepare() {
+        user_stmt_ = prepare("INSERT OR IGNORE INTO users (id, email, display_name) VALUES (?, ?, ?)");
+        position_stmt_ = prepare("INSERT INTO positions (id, title, created_by, created_at) VALUES (?, ?, ?, ?)");
+        candidate_stmt_ = prepare(
+            "INSERT INTO candidates (id, position_id, name, created_at) VALUES (?, ?, ?, ?)");
+        feedback_stmt_ = prepare("INSERT INTO candidate_feedback (candidate_id, codec, size, body) VALUES (?, ?, ?, ?)");
+        score_stmt_ = prepare(
+            "INSERT INTO scores (id, candidate_id, interviewer_id, hand_gestures, stayed_awake, created_at, updated_at) "
+            "VALUES (?, ?, ?, ?, ?, ?6, ?6)");
+    }
+
+    sqlite3_stmt* prepare(const char* sql) {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error(std::string("prepare failed: ") + sqlite3_errmsg(db_));
+        }
+        return stmt;
+    }
+
+    void bind(sqlite3_stmt* stmt, int index, const std::string& value) {
+        sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+    }
+
+    void step(sqlite3_stmt* stmt) {
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            throw std::runtime_error(std::string("insert failed: ") + sqlite3_errmsg(db_));
+        }
+        sqlite3_reset(stmt);
+        rows_in_batch_++;
+    }
+
+    void exec(const char* sql) {
+        char* err = nullptr;
+        if (sqlite3_exec(db_, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+            std::string message = err ? err : "unknown error";
+            sqlite3_free(err);
+            throw std::runtime_error(message);
+        }
+    }
+
+    void begin() { exec("BEGIN"); rows_in_batch_ = 0; }
+    void commit() { exec("COMMIT"); }
+
+    std::string uuid() {
+        static const char* hex = "0123456789abcdef";
+        uint64_t a = rng_(), b = rng_();
+        std::string id = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
+        int bit = 0;
+        for (char& c : id) {
+            if (c != 'x' && c != 'y') continue;
+            uint64_t& src = bit < 64 ? a : b;
+            int nibble = (src >> (bit % 64)) & 0xf;
+            c = c == 'x' ? hex[nibble] : hex[(nibble & 0x3) | 0x8];
+            bit += 4;
+        }
+        return id;
+    }
+
+    static std::string timestamp(std::time_t t) {
+        char buf[32];
+        std::tm tm_utc;
+        gmtime_r(&t, &tm_utc);
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_utc);
+        return buf;
+    }
+
+    static const char* department(long p) {
+        static const char* names[] = {"Chemistry", "Physics", "Computing", "Linguistics", "Economics",
+                                      "History", "Mathematics", "Psychology", "Law", "Medicine"};
+        return names[p % 10];
+    }
+
+    // Word-salad evaluation text of roughly --feedback-bytes, +/- 50%
+    void fill_feedback(std::string& out) {
+        static const char* words[] = {"clear", "engaging", "lecture", "students", "explained", "examples",
+                                      "helpful", "pace", "too", "fast", "assessment", "feedback", "always",
+                                      "available", "enthusiastic", "slides", "tutorial", "recommend"};
+        std::uniform_int_distribution<long> size(opt_.feedback_bytes / 2, opt_.feedback_bytes * 3 / 2);
+        std::uniform_int_distribution<int> word(0, sizeof(words) / sizeof(words[0]) - 1);
+        long target = size(rng_);
+        out.clear();
+        while (static_cast<long>(out.size()) < target) {
+            out += words[word(rng_)];
+            out += out.size() % 97 < 8 ? ".\n" : " ";
+        }
+    }
+
+    void report(const char* what, long count) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        long rows = positions_ + candidates_ + scores_;
+        std::cerr << "datagen: " << count << " " << what << ", " << rows << " rows, "
+                  << static_cast<long>(secs > 0 ? rows / secs : 0) << " rows/s" << std::endl;
+    }
+
+    sqlite3* db_;
+    const Options& opt_;
+    std::mt19937_64 rng_;
+    sqlite3_stmt* user_stmt_ = nullptr;
+    sqlite3_stmt* position_stmt_ = nullptr;
+    sqlite3_stmt* candidate_stmt_ = nullptr;
+    sqlite3_stmt* feedback_stmt_ = nullptr;
+    sqlite3_stmt* score_stmt_ = nullptr;
+    long rows_in_batch_ = 0;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+int main(int argc, char** argv) {
+    auto args = parse_args(argc, argv);
+    if (args.count("help")) {
+        std::cout << "usage: datagen [--db PATH] [--users N] [--positions N] [--candidates-per-position N]\n"
+                     "               [--scores-per-candidate N] [--feedback-bytes N] [--feedback-ratio R]\n"
+                     "               [--batch ROWS] [--years N] [--seed N] [--keep-indexes]\n";
+        return 0;
+    }
+
+    Options opt;
+    opt.db_path = arg_or(args, "db", "candidate_scoring.db");
+    opt.users = std::stol(arg_or(args, "users", "200"));
+    opt.positions = std::stol(arg_or(args, "positions", "1000"));
+    opt.candidates_per_position = std::stol(arg_or(args, "candidates-per-position", "8"));
+    opt.scores_per_candidate = std::stol(arg_or(args, "scores-per-candidate", "5"));
+    opt.feedback_bytes = std::stol(arg_or(args, "feedback-bytes", "1000"));
+    opt.feedback_ratio = std::stod(arg_or(args, "feedback-ratio", "0.5"));
+    opt.batch = std::stol(arg_or(args, "batch", "200000"));
+    opt.years = std::stoi(arg_or(args, "years", "5"));
+    opt.seed = static_cast<unsigned>(std::stoul(arg_or(args, "seed", "42")));
+    opt.keep_indexes = args.count("keep-indexes") > 0;
+
+    if (opt.users <= 0 || opt.positions < 0 || opt.batch <= 0) {
+        std::cerr << "datagen: --users and --batch must be positive" << std::endl;
+        return 1;
+    }
+
+    try {
+        Database db(opt.db_path);
+        sqlite3_exec(db.db, "PRAGMA synchronous = OFF", nullptr, nullptr, nullptr);
+        sqlite3_exec(db.db, "PRAGMA journal_mode = MEMORY", nullptr, nullptr, nullptr);
+        sqlite3_exec(db.db, "PRAGMA cache_size = -262144", nullptr, nullptr, nullptr);
+
+        const char* secondary_indexes[] = {"idx_candidates_position", "idx_scores_candidate",
+                                           "idx_scores_interviewer", "idx_positions_created_by",
+                                           "idx_positions_created_at"};
+        // Before the indexes go: a crash from here on leaves the triggers
+        // missing, and the next open puts back both
+        db.begin_bulk_load();
+        if (!opt.keep_indexes) {
+            for (const char* index : secondary_indexes) {
+                sqlite3_exec(db.db, ("DROP INDEX IF EXISTS " + std::string(index)).c_str(),
+                             nullptr, nullptr, nullptr);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Generator gen(db.db, opt);
+        gen.run();
+
+        if (!opt.keep_indexes) {
+            std::cerr << "datagen: rebuilding indexes" << std::endl;
+            db.create_indexes();
+        }
+        for (const char* index : secondary_indexes) {
+            if (!db.has_index(index)) throw std::runtime_error(std::string("index ") + index + " missing after load");
+        }
+        std::cerr << "datagen: updating candidate counts and change log" << std::endl;
+        db.end_bulk_load();
+        // Generator inserts bypass the Database write paths
+        std::cerr << "datagen: rebuilding search index" << std::endl;
+        db.rebuild_search_index();
+        // Last, so the statistics cover the rebuilt indexes
+        std::cerr << "datagen: analyzing" << std::endl;
+        sqlite3_exec(db.db, "ANALYZE", nullptr, nullptr, nullptr);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        long rows = gen.positions_ + gen.candidates_ + gen.scores_;
+        std::cout << "{\"tool\":\"datagen\",\"positions\":" << gen.positions_
+                  << ",\"candidates\":" << gen.candidates_ << ",\"scores\":" << gen.scores_
+                  << ",\"seconds\":" << secs << ",\"rows_per_second\":" << static_cast<long>(rows / secs)
+                  << "}" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "datagen: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
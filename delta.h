@@ -0,0 +1,171 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Binary deltas between feedback revisions (see feedback_revisions).
+//
+// A delta is the target's length followed by a list of operations, each a
+// varint tag with the length in the high bits:
+//   (len << 1) | 1, offset   copy len bytes of the base from offset
+//   (len << 1) | 0, bytes    insert the len bytes that follow
+// Copies are found rsync-style: the base is indexed by a rolling hash of
+// each delta_block-byte block, and the hash is rolled over the target one
+// byte at a time. A one-word edit costs a couple of ops whatever the size
+// of the document.
+
+const size_t delta_block = 16;
+
+namespace delta_detail {
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+inline bool get_varint(std::string_view in, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= in.size()) return false;
+        unsigned char c = static_cast<unsigned char>(in[pos++]);
+        v |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+// Adler-style checksum that can drop its first byte and take a new last one
+struct RollingHash {
+    uint32_t a = 0, b = 0;
+
+    void init(const unsigned char* p) {
+        a = b = 0;
+        for (size_t i = 0; i < delta_block; i++) {
+            a += p[i];
+            b += a;
+        }
+    }
+
+    void roll(unsigned char out, unsigned char in) {
+        a += in - out;
+        b += a - static_cast<uint32_t>(delta_block) * out;
+    }
+
+    uint32_t value() const { return (b << 16) ^ a; }
+};
+
+inline void emit_insert(std::string& out, std::string_view target, size_t from, size_t to) {
+    if (to <= from) return;
+    put_varint(out, static_cast<uint64_t>(to - from) << 1);
+    out.append(target.data() + from, to - from);
+}
+
+inline void emit_copy(std::string& out, size_t offset, size_t len) {
+    if (len == 0) return;
+    put_varint(out, (static_cast<uint64_t>(len) << 1) | 1);
+    put_varint(out, offset);
+}
+
+} // namespace delta_detail
+
+// Delta that turns base into target
+inline std::string make_delta(std::string_view base, std::string_view target) {
+    using namespace delta_detail;
+    std::string out;
+    put_varint(out, target.size());
+
+    // Most edits touch the middle of a document; take the shared ends first
+    size_t prefix = 0;
+    size_t limit = std::min(base.size(), target.size());
+    while (prefix < limit && base[prefix] == target[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < limit - prefix &&
+           base[base.size() - 1 - suffix] == target[target.size() - 1 - suffix]) {
+        suffix++;
+    }
+    emit_copy(out, 0, prefix);
+
+    size_t base_end = base.size() - suffix;
+    size_t target_end = target.size() - suffix;
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(base.data());
+    const unsigned char* t = reinterpret_cast<const unsigned char*>(target.data());
+
+    // First offset of each block of the base's middle, by hash
+    std::unordered_map<uint32_t, size_t> blocks;
+    if (base_end - prefix >= delta_block && target_end - prefix >= delta_block) {
+        blocks.reserve((base_end - prefix) / delta_block);
+        RollingHash h;
+        for (size_t off = prefix; off + delta_block <= base_end; off += delta_block) {
+            h.init(b + off);
+            blocks.emplace(h.value(), off);
+        }
+    }
+
+    size_t pending = prefix;     // start of bytes not yet emitted
+    size_t pos = prefix;
+    RollingHash h;
+    bool hashed = false;
+    while (!blocks.empty() && pos + delta_block <= target_end) {
+        if (!hashed) {
+            h.init(t + pos);
+            hashed = true;
+        }
+        auto it = blocks.find(h.value());
+        if (it != blocks.end() && std::memcmp(b + it->second, t + pos, delta_block) == 0) {
+            size_t from = it->second;
+            size_t len = delta_block;
+            while (pos + len < target_end && from + len < base_end && b[from + len] == t[pos + len]) len++;
+            // Grow backwards into the bytes that would otherwise be inserted
+            size_t back = 0;
+            while (pos - back > pending && from - back > prefix && b[from - back - 1] == t[pos - back - 1]) back++;
+            emit_insert(out, target, pending, pos - back);
+            emit_copy(out, from - back, len + back);
+            pos += len;
+            pending = pos;
+            hashed = false;
+            continue;
+        }
+        if (pos + delta_block < target_end) h.roll(t[pos], t[pos + delta_block]);
+        pos++;
+    }
+    emit_insert(out, target, pending, target_end);
+    emit_copy(out, base_end, suffix);
+    return out;
+}
+
+// Applies a delta from make_delta to base. False if the delta is malformed
+// or does not fit base.
+inline bool apply_delta(std::string_view base, std::string_view delta, std::string& out) {
+    using namespace delta_detail;
+    size_t pos = 0;
+    uint64_t size;
+    if (!get_varint(delta, pos, size)) return false;
+    out.clear();
+    out.reserve(std::min<uint64_t>(size, base.size() + delta.size()));
+    while (pos < delta.size()) {
+        uint64_t tag;
+        if (!get_varint(delta, pos, tag)) return false;
+        uint64_t len = tag >> 1;
+        if (tag & 1) {
+            uint64_t offset;
+            if (!get_varint(delta, pos, offset) || offset > base.size() || len > base.size() - offset) return false;
+            out.append(base.data() + offset, len);
+        } else {
+            if (len > delta.size() - pos) return false;
+            out.append(delta.data() + pos, len);
+            pos += len;
+        }
+        if (out.size() > size) return false;
+    }
+    return out.size() == size;
+}
+
+#endif // DELTA_H
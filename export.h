@@ -0,0 +1,225 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <sqlite3.h>
+#include <zlib.h>
+#include "json.h"
+
+// Streaming export of every position's rankings for GET /export/rankings.
+//
+// Each export opens its own read-only connection. With the main connection
+// in WAL mode the export reads one consistent snapshot while scoring writes
+// carry on, and it never takes the shared connection's mutex. Rows are
+// formatted a chunk at a time straight from the cursor, so the server holds
+// one chunk of output, never the whole result. Archived positions are read
+// from the archive database, attached to the same connection.
+
+class RankingExport {
+public:
+    enum Format { Csv, Ndjson };
+
+    static constexpr size_t chunk_bytes = 64 * 1024;
+
+    // archive_path empty: there is no archive database
+    RankingExport(const std::string& db_path, const std::string& archive_path, Format format) : format_(format) {
+        if (sqlite3_open_v2(db_path.c_str(), &db_, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) return;
+        bool archive = false;
+        if (!archive_path.empty()) {
+            sqlite3_stmt* attach;
+            sqlite3_prepare_v2(db_, "ATTACH DATABASE ? AS archive", -1, &attach, nullptr);
+            sqlite3_bind_text(attach, 1, archive_path.c_str(), -1, SQLITE_TRANSIENT);
+            archive = sqlite3_step(attach) == SQLITE_DONE;
+            sqlite3_finalize(attach);
+        }
+        // One snapshot for the whole export, across every statement
+        sqlite3_exec(db_, "BEGIN", nullptr, nullptr, nullptr);
+        sqlite3_prepare_v2(db_, archive ? R"(
+            SELECT id, title, 0 FROM main.positions WHERE archived_at IS NULL
+            UNION ALL
+            SELECT id, title, 1 FROM archive.positions
+            WHERE id NOT IN (SELECT id FROM main.positions WHERE archived_at IS NULL)
+            ORDER BY 1
+        )" : "SELECT id, title, 0 FROM positions ORDER BY id", -1, &positions_, nullptr);
+        // Same ordering as the position page; one small sort per position
+        // instead of a sort over every candidate in the database
+        const char* rankings = R"(
+            SELECT c.id, c.name, COUNT(s.id), AVG(s.hand_gestures), AVG(s.stayed_awake),
+                   (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2
+            FROM main.candidates c
+            LEFT JOIN main.scores s ON c.id = s.candidate_id
+            WHERE c.position_id = ?
+            GROUP BY c.id
+            ORDER BY (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2 DESC NULLS LAST, c.name
+        )";
+        sqlite3_prepare_v2(db_, rankings, -1, &rankings_, nullptr);
+        if (archive) {
+            std::string archived = rankings;
+            for (const char* table : {"main.candidates", "main.scores"}) {
+                size_t at = archived.find(table);
+                archived.replace(at, 4, "archive");
+            }
+            sqlite3_prepare_v2(db_, archived.c_str(), -1, &archived_rankings_, nullptr);
+        }
+    }
+
+    ~RankingExport() {
+        sqlite3_finalize(positions_);
+        sqlite3_finalize(rankings_);
+        sqlite3_finalize(archived_rankings_);
+        sqlite3_close(db_);
+    }
+
+    RankingExport(const RankingExport&) = delete;
+    RankingExport& operator=(const RankingExport&) = delete;
+
+    bool ok() const { return positions_ && rankings_; }
+
+    // Replaces out with the next chunk of rows. Returns false once the
+    // cursor is exhausted (out may still hold a final partial chunk).
+    bool next_chunk(std::string& out) {
+        out.clear();
+        if (!header_written_ && format_ == Csv) {
+            out += "position_id,position_title,rank,candidate_id,candidate_name,"
+                   "num_scores,avg_hand_gestures,avg_stayed_awake,avg_total\n";
+        }
+        header_written_ = true;
+        while (out.size() < chunk_bytes) {
+            if (!in_position_ || sqlite3_step(current_) != SQLITE_ROW) {
+                // Next position
+                if (current_) sqlite3_reset(current_);
+                if (sqlite3_step(positions_) != SQLITE_ROW) return false;
+                position_id_ = text(positions_, 0);
+                position_title_ = text(positions_, 1);
+                current_ = sqlite3_column_int(positions_, 2) && archived_rankings_ ? archived_rankings_ : rankings_;
+                sqlite3_bind_text(current_, 1, position_id_.c_str(), -1, SQLITE_STATIC);
+                in_position_ = true;
+                rank_ = 0;
+                continue;
+            }
+            rank_++;
+            format_ == Csv ? csv_row(out) : ndjson_row(out);
+        }
+        return true;
+    }
+
+private:
+    static std::string_view text(sqlite3_stmt* stmt, int col) {
+        const char* t = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+        return t ? std::string_view(t, sqlite3_column_bytes(stmt, col)) : std::string_view();
+    }
+
+    // Empty when unscored, otherwise two decimal places as on the pages
+    void number(std::string& out, int col) const {
+        if (sqlite3_column_type(current_, col) == SQLITE_NULL) return;
+        char buf[32];
+        out.append(buf, snprintf(buf, sizeof(buf), "%.2f", sqlite3_column_double(current_, col)));
+    }
+
+    static void csv_field(std::string& out, std::string_view s) {
+        if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+            out += s;
+            return;
+        }
+        out += '"';
+        for (char c : s) {
+            if (c == '"') out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+
+    void csv_row(std::string& out) const {
+        csv_field(out, position_id_);
+        out += ',';
+        csv_field(out, position_title_);
+        out += ',';
+        out += std::to_string(rank_);
+        out += ',';
+        csv_field(out, text(current_, 0));
+        out += ',';
+        csv_field(out, text(current_, 1));
+        out += ',';
+        out += text(current_, 2);
+        for (int col = 3; col <= 5; col++) {
+            out += ',';
+            number(out, col);
+        }
+        out += '\n';
+    }
+
+    void ndjson_row(std::string& out) const {
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("position_id", position_id_);
+        w.field("position_title", position_title_);
+        w.field("rank", rank_);
+        w.field("candidate_id", text(current_, 0));
+        w.field("candidate_name", text(current_, 1));
+        w.field("num_scores", sqlite3_column_int(current_, 2));
+        static const char* averages[] = {"avg_hand_gestures", "avg_stayed_awake", "avg_total"};
+        for (int col = 3; col <= 5; col++) {
+            w.key(averages[col - 3]);
+            if (sqlite3_column_type(current_, col) == SQLITE_NULL) {
+                w.null();
+            } else {
+                w.value(sqlite3_column_double(current_, col));
+            }
+        }
+        w.end_object();
+        out += '\n';
+    }
+
+    sqlite3* db_ = nullptr;
+    sqlite3_stmt* positions_ = nullptr;
+    sqlite3_stmt* rankings_ = nullptr;
+    sqlite3_stmt* archived_rankings_ = nullptr;
+    sqlite3_stmt* current_ = nullptr;       // rankings_ or archived_rankings_
+    Format format_;
+    bool header_written_ = false;
+    bool in_position_ = false;
+    std::string position_id_;
+    std::string position_title_;
+    int rank_ = 0;
+};
+
+// Incremental gzip (RFC 1952) encoder for chunked responses
+class GzipStream {
+public:
+    GzipStream() {
+        // windowBits 15 + 16 selects the gzip wrapper; level 6 is zlib's default trade-off
+        ok_ = deflateInit2(&z_, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~GzipStream() {
+        if (ok_) deflateEnd(&z_);
+    }
+
+    GzipStream(const GzipStream&) = delete;
+    GzipStream& operator=(const GzipStream&) = delete;
+
+    // Compresses in and appends to out; finish flushes the trailer
+    bool write(std::string_view in, std::string& out, bool finish) {
+        if (!ok_) return false;
+        z_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        z_.avail_in = static_cast<uInt>(in.size());
+        char buf[16384];
+        int ret;
+        do {
+            z_.next_out = reinterpret_cast<Bytef*>(buf);
+            z_.avail_out = sizeof(buf);
+            ret = deflate(&z_, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (ret == Z_STREAM_ERROR) return false;
+            out.append(buf, sizeof(buf) - z_.avail_out);
+        } while (z_.avail_out == 0 || (finish && ret != Z_STREAM_END));
+        return true;
+    }
+
+private:
+    z_stream z_{};
+    bool ok_ = false;
+};
+
+#endif // EXPORT_H
@@ -0,0 +1,231 @@
+#ifndef FEEDBACK_H
+#define FEEDBACK_H
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <sqlite3.h>
+#include <zlib.h>
+#include "compress.h"
+#include "database.h"
+
+// Streaming feedback documents for PUT/POST/GET /candidates/:id/feedback.
+//
+// An upload is compressed as it arrives and written into a staging blob
+// sized from Content-Length (zlib's worst case for that many bytes), so
+// neither the request body nor the compressed document is ever held whole.
+// A download reads the stored blob a piece at a time on its own read-only
+// connection and inflates it as it goes.
+
+class FeedbackUpload {
+public:
+    static constexpr size_t max_size = 32 * 1024 * 1024;
+    static constexpr size_t write_bytes = 64 * 1024;
+    // Only the start of a long document goes into the search index
+    static constexpr size_t search_bytes = 64 * 1024;
+
+    // content_length bounds the document; a multipart body's part is smaller
+    FeedbackUpload(Database& db, std::string candidate_id, size_t content_length)
+        : db_(db), candidate_id_(std::move(candidate_id)) {
+        if (deflateInit(&z_, Z_BEST_SPEED) != Z_OK) return;
+        z_ok_ = true;
+        capacity_ = deflateBound(&z_, content_length);
+        upload_ = db_.begin_feedback_upload(candidate_id_, capacity_);
+    }
+
+    ~FeedbackUpload() {
+        if (z_ok_) deflateEnd(&z_);
+        if (upload_ && !finished_) db_.cancel_feedback_upload(upload_);
+    }
+
+    FeedbackUpload(const FeedbackUpload&) = delete;
+    FeedbackUpload& operator=(const FeedbackUpload&) = delete;
+
+    bool ok() const { return upload_ != 0; }
+
+    bool feed(const char* data, size_t len) {
+        if (!upload_) return false;
+        if (size_ + len > max_size) {
+            too_large_ = true;
+            return false;
+        }
+        size_ += len;
+        if (search_text_.size() < search_bytes) {
+            search_text_.append(data, std::min(len, search_bytes - search_text_.size()));
+        }
+        return deflate_into(data, len, Z_NO_FLUSH);
+    }
+
+    // Stores the document as the candidate's feedback. An empty upload
+    // clears it, as an empty form field does.
+    bool finish() {
+        if (!upload_) return false;
+        if (size_ == 0) {
+            db_.update_feedback(candidate_id_, "");
+            return true;
+        }
+        if (!deflate_into(nullptr, 0, Z_FINISH) || !flush()) return false;
+        trim_utf8(search_text_);
+        finished_ = db_.finish_feedback_upload(upload_, candidate_id_, text_zlib, size_, stored_, search_text_);
+        return finished_;
+    }
+
+    size_t size() const { return size_; }
+    size_t stored() const { return stored_; }
+    bool too_large() const { return too_large_; }
+
+private:
+    bool deflate_into(const char* data, size_t len, int flush_mode) {
+        z_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        z_.avail_in = static_cast<uInt>(len);
+        char buf[16384];
+        int ret;
+        do {
+            z_.next_out = reinterpret_cast<Bytef*>(buf);
+            z_.avail_out = sizeof(buf);
+            ret = deflate(&z_, flush_mode);
+            if (ret == Z_STREAM_ERROR) return false;
+            pending_.append(buf, sizeof(buf) - z_.avail_out);
+        } while (z_.avail_out == 0 || (flush_mode == Z_FINISH && ret != Z_STREAM_END));
+        return pending_.size() < write_bytes || flush();
+    }
+
+    bool flush() {
+        if (pending_.empty()) return true;
+        if (stored_ + pending_.size() > capacity_) return false;
+        if (!db_.write_feedback_upload(upload_, stored_, pending_.data(), pending_.size())) return false;
+        stored_ += pending_.size();
+        pending_.clear();
+        return true;
+    }
+
+    // Drops a multi-byte character cut off at the end of s
+    static void trim_utf8(std::string& s) {
+        size_t i = s.size();
+        size_t back = 0;
+        while (i > 0 && back < 4 && (static_cast<unsigned char>(s[i - 1]) & 0xC0) == 0x80) {
+            i--;
+            back++;
+        }
+        if (i == 0) return;
+        unsigned char lead = static_cast<unsigned char>(s[i - 1]);
+        size_t need = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+        if (need != back) s.resize(lead >= 0xC0 ? i - 1 : i);
+    }
+
+    Database& db_;
+    std::string candidate_id_;
+    z_stream z_{};
+    bool z_ok_ = false;
+    size_t capacity_ = 0;
+    sqlite3_int64 upload_ = 0;
+    bool finished_ = false;
+    bool too_large_ = false;
+    size_t size_ = 0;
+    size_t stored_ = 0;
+    std::string pending_;
+    std::string search_text_;
+};
+
+class FeedbackDownload {
+public:
+    static constexpr size_t read_bytes = 16 * 1024;
+
+    // With raw, a compressed document is passed through as stored (a zlib
+    // stream, i.e. Content-Encoding: deflate) instead of being inflated.
+    // Feedback of an archived position is read from archive_path.
+    FeedbackDownload(const std::string& db_path, const std::string& archive_path, const std::string& candidate_id,
+                     bool raw) : raw_(raw) {
+        if (sqlite3_open_v2(db_path.c_str(), &db_, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) return;
+        bool archive = false;
+        if (!archive_path.empty()) {
+            sqlite3_stmt* attach;
+            sqlite3_prepare_v2(db_, "ATTACH DATABASE ? AS archive", -1, &attach, nullptr);
+            sqlite3_bind_text(attach, 1, archive_path.c_str(), -1, SQLITE_TRANSIENT);
+            archive = sqlite3_step(attach) == SQLITE_DONE;
+            sqlite3_finalize(attach);
+        }
+        // The lookup and the blob reads see one snapshot
+        sqlite3_exec(db_, "BEGIN", nullptr, nullptr, nullptr);
+        if (!open_blob("main", candidate_id) && archive) open_blob("archive", candidate_id);
+        if (blob_ && codec_ == text_zlib && !raw_) z_ok_ = inflateInit(&z_) == Z_OK;
+    }
+
+    ~FeedbackDownload() {
+        if (z_ok_) inflateEnd(&z_);
+        sqlite3_blob_close(blob_);
+        sqlite3_close(db_);
+    }
+
+    FeedbackDownload(const FeedbackDownload&) = delete;
+    FeedbackDownload& operator=(const FeedbackDownload&) = delete;
+
+    // False if the candidate has no feedback (or it cannot be read)
+    bool found() const { return blob_ && (codec_ == text_raw || raw_ || z_ok_); }
+    bool compressed() const { return codec_ == text_zlib; }
+
+    // Replaces out with the next piece of the document. Returns false once
+    // everything has been read (out may still hold the final piece).
+    bool next_chunk(std::string& out) {
+        out.clear();
+        if (offset_ >= stored_) return false;
+        char in[read_bytes];
+        int n = static_cast<int>(std::min(sizeof(in), stored_ - offset_));
+        if (sqlite3_blob_read(blob_, in, n, static_cast<int>(offset_)) != SQLITE_OK) {
+            offset_ = stored_;
+            return false;
+        }
+        offset_ += n;
+        if (codec_ == text_raw || raw_) {
+            out.assign(in, n);
+            return offset_ < stored_;
+        }
+
+        z_.next_in = reinterpret_cast<Bytef*>(in);
+        z_.avail_in = static_cast<uInt>(n);
+        char buf[64 * 1024];
+        int ret;
+        do {
+            z_.next_out = reinterpret_cast<Bytef*>(buf);
+            z_.avail_out = sizeof(buf);
+            ret = inflate(&z_, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                offset_ = stored_;
+                return false;
+            }
+            out.append(buf, sizeof(buf) - z_.avail_out);
+        } while (z_.avail_out == 0);
+        return offset_ < stored_ && ret != Z_STREAM_END;
+    }
+
+private:
+    // Opens the candidate's feedback in schema ("main" or "archive")
+    bool open_blob(const char* schema, const std::string& candidate_id) {
+        std::string sql = std::string("SELECT rowid, codec, size FROM ") + schema + ".candidate_feedback WHERE candidate_id = ?";
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            sqlite3_int64 rowid = sqlite3_column_int64(stmt, 0);
+            codec_ = sqlite3_column_int(stmt, 1);
+            size_ = static_cast<size_t>(sqlite3_column_int64(stmt, 2));
+            if (sqlite3_blob_open(db_, schema, "candidate_feedback", "body", rowid, 0, &blob_) == SQLITE_OK) {
+                stored_ = static_cast<size_t>(sqlite3_blob_bytes(blob_));
+            }
+        }
+        sqlite3_finalize(stmt);
+        return blob_ != nullptr;
+    }
+
+    sqlite3* db_ = nullptr;
+    sqlite3_blob* blob_ = nullptr;
+    bool raw_;
+    int codec_ = text_raw;
+    size_t size_ = 0;
+    size_t stored_ = 0;
+    size_t offset_ = 0;
+    z_stream z_{};
+    bool z_ok_ = false;
+};
+
+#endif // FEEDBACK_H
@@ -0,0 +1,160 @@
+#ifndef FOLLOWER_H
+#define FOLLOWER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "httplib.h"
+#include "api.h"
+#include "database.h"
+#include "json.h"
+#include "ranking_hub.h"
+#include "trace.h"
+
+// Read-only follower mode (CANDIDATE_SCORING_FOLLOW=http://primary:5000).
+//
+// A background thread tails the primary's change log through /api/changes,
+// a page at a time, and applies each page to this process's own database
+// with Database::apply_changes. The applied version is stored in the same
+// transaction, so a restarted follower carries on where it stopped. Pages
+// come back to back while the follower is behind; once caught up it polls
+// every poll_interval. Live ranking watchers on the follower are notified
+// as changes land.
+//
+// Lag is reported two ways by /admin/replication: change-log entries not
+// yet applied, and time since the follower last knew it had everything.
+
+class Follower {
+public:
+    static constexpr auto poll_interval = std::chrono::milliseconds(250);
+    static constexpr auto retry_interval = std::chrono::milliseconds(1000);
+    static constexpr int page_size = 1000;
+
+    Follower(Database& db, RankingHub& hub, std::string primary)
+        : db_(db), hub_(hub), primary_(std::move(primary)), version_(db.replication_version(primary_)),
+          worker_([this] { run(); }) {}
+
+    ~Follower() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+
+    Follower(const Follower&) = delete;
+    Follower& operator=(const Follower&) = delete;
+
+    std::string status_json() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("role", "follower");
+        w.field("primary", primary_);
+        w.field("version", static_cast<long long>(version_));
+        w.field("primary_version", static_cast<long long>(latest_));
+        w.field("lag_versions", static_cast<long long>(std::max<int64_t>(latest_ - version_, 0)));
+        w.key("lag_ms");
+        if (in_sync_at_.time_since_epoch().count() == 0) {
+            w.null();
+        } else {
+            w.value(std::chrono::duration<double, std::milli>(now - in_sync_at_).count(), 0);
+        }
+        w.field("pages_applied", static_cast<long long>(pages_));
+        w.field("errors", static_cast<long long>(errors_));
+        if (!last_error_.empty()) w.field("last_error", last_error_);
+        w.key("last_apply_ms");
+        w.value(last_apply_ms_, 3);
+        w.end_object();
+        return out;
+    }
+
+private:
+    void run() {
+        httplib::Client client(primary_);
+        client.set_connection_timeout(2);
+        client.set_read_timeout(30);
+        while (true) {
+            bool more = poll(client);
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stopping_) break;
+            if (!more) {
+                cv_.wait_for(lock, last_error_.empty() ? poll_interval : retry_interval, [this] { return stopping_; });
+                if (stopping_) break;
+            }
+        }
+    }
+
+    // Fetches and applies the next page. Returns true if more are waiting.
+    bool poll(httplib::Client& client) {
+        auto asked = std::chrono::steady_clock::now();
+        auto res = client.Get("/api/changes?since=" + std::to_string(version_) + "&limit=" + std::to_string(page_size));
+        ChangeSet changes;
+        if (!res || res->status != 200 || !parse_changes(res->body, changes)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            errors_++;
+            last_error_ = !res ? httplib::to_string(res.error())
+                               : res->status != 200 ? "HTTP " + std::to_string(res->status) : "unreadable change set";
+            return false;
+        }
+
+        if (changes.latest < version_) {
+            // A different or restored primary; this copy cannot follow it
+            std::lock_guard<std::mutex> lock(mutex_);
+            errors_++;
+            latest_ = changes.latest;
+            last_error_ = "primary's change log ends before this follower's version";
+            return false;
+        }
+
+        std::vector<std::string> positions;
+        uint64_t started = Tracer::now_ns();
+        bool applied = changes.version == version_ || db_.apply_changes(primary_, changes, positions);
+        double apply_ms = (Tracer::now_ns() - started) / 1e6;
+
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+        for (const std::string& id : positions) hub_.notify(id);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        latest_ = changes.latest;
+        if (!applied) {
+            errors_++;
+            last_error_ = "could not apply changes after version " + std::to_string(version_);
+            return false;
+        }
+        last_error_.clear();
+        if (changes.version != version_) {
+            pages_++;
+            last_apply_ms_ = apply_ms;
+        }
+        version_ = changes.version;
+        // Everything up to when the request was made is now applied
+        if (!changes.more) in_sync_at_ = asked;
+        return changes.more;
+    }
+
+    Database& db_;
+    RankingHub& hub_;
+    std::string primary_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    int64_t version_;
+    int64_t latest_ = 0;
+    int64_t pages_ = 0;
+    int64_t errors_ = 0;
+    std::string last_error_;
+    double last_apply_ms_ = 0;
+    std::chrono::steady_clock::time_point in_sync_at_{};
+    std::thread worker_;
+};
+
+#endif // FOLLOWER_H
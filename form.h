@@ -0,0 +1,46 @@
+#ifndef FORM_H
+#define FORM_H
+
+#include <map>
+#include <sstream>
+#include <string>
+
+// URL decode
+inline std::string url_decode(const std::string& s) {
+    std::string result;
+    for (size_t i = 0; i < s.length(); i++) {
+        if (s[i] == '%' && i + 2 < s.length()) {
+            int val;
+            std::istringstream iss(s.substr(i + 1, 2));
+            if (iss >> std::hex >> val) {
+                result += static_cast<char>(val);
+                i += 2;
+            } else {
+                result += s[i];
+            }
+        } else if (s[i] == '+') {
+            result += ' ';
+        } else {
+            result += s[i];
+        }
+    }
+    return result;
+}
+
+// Parse form data
+inline std::map<std::string, std::string> parse_form(const std::string& body) {
+    std::map<std::string, std::string> params;
+    std::istringstream stream(body);
+    std::string pair;
+    while (std::getline(stream, pair, '&')) {
+        size_t pos = pair.find('=');
+        if (pos != std::string::npos) {
+            std::string key = url_decode(pair.substr(0, pos));
+            std::string value = url_decode(pair.substr(pos + 1));
+            params[key] = value;
+        }
+    }
+    return params;
+}
+
+#endif // FORM_H
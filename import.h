@@ -0,0 +1,258 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "database.h"
+#include "json.h"
+
+// Streaming bulk candidate import for
+// POST /positions/:id/candidates/import. The upload is fed through in
+// whatever chunks the socket delivers; rows are buffered only until a batch
+// is full, so memory use does not depend on the file size.
+//
+// CSV: an optional header row naming "name" and "student_feedback" (or
+// "feedback") columns; without one, column 1 is the name and column 2 the
+// feedback. Quoted fields follow RFC 4180 and may contain commas, quotes and
+// newlines.
+// NDJSON: one {"name": "...", "student_feedback": "..."} object per line.
+
+// Incremental RFC 4180 parser. feed() may split the input anywhere,
+// including inside a quoted field or between the two quotes of an escaped "".
+class CsvReader {
+public:
+    explicit CsvReader(size_t max_field) : max_field_(max_field) {}
+
+    // Calls on_record(const std::vector<std::string>& fields, size_t line)
+    // for each complete record. Returns false once a field exceeds max_field.
+    template <typename Fn>
+    bool feed(const char* data, size_t len, Fn&& on_record) {
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+            if (quote_pending_) {
+                quote_pending_ = false;
+                if (c == '"') {
+                    field_ += '"';
+                    in_quotes_ = true;
+                    continue;
+                }
+            }
+            if (in_quotes_) {
+                if (c == '"') {
+                    in_quotes_ = false;
+                    quote_pending_ = true;
+                } else {
+                    if (c == '\n') line_++;
+                    field_ += c;
+                }
+            } else if (c == ',') {
+                end_field();
+            } else if (c == '\n') {
+                end_record(on_record);
+                line_++;
+                record_line_ = line_;
+            } else if (c == '"' && field_.empty()) {
+                in_quotes_ = true;
+            } else if (c != '\r') {
+                field_ += c;
+            }
+            if (field_.size() > max_field_) return false;
+        }
+        return true;
+    }
+
+    // Flushes a final record that has no trailing newline
+    template <typename Fn>
+    void finish(Fn&& on_record) {
+        if (!field_.empty() || !fields_.empty()) end_record(on_record);
+    }
+
+    size_t line() const { return line_; }
+
+private:
+    void end_field() {
+        fields_.push_back(std::move(field_));
+        field_.clear();
+    }
+
+    template <typename Fn>
+    void end_record(Fn&& on_record) {
+        end_field();
+        // Blank lines are not records
+        if (fields_.size() > 1 || !fields_[0].empty()) on_record(fields_, record_line_);
+        fields_.clear();
+    }
+
+    size_t max_field_;
+    std::vector<std::string> fields_;
+    std::string field_;
+    bool in_quotes_ = false;
+    bool quote_pending_ = false;
+    size_t line_ = 1;
+    size_t record_line_ = 1;
+};
+
+class CandidateImport {
+public:
+    static constexpr size_t batch_rows = 1000;
+    static constexpr size_t batch_bytes = 1 << 20;
+    static constexpr size_t max_field = 64 * 1024;
+    static constexpr size_t max_errors = 20;
+
+    enum Format { Csv, Ndjson };
+
+    CandidateImport(Database& db, std::string position_id, Format format)
+        : db_(db), position_id_(std::move(position_id)), format_(format), csv_(max_field),
+          start_(std::chrono::steady_clock::now()) {
+        batch_.reserve(batch_rows);
+    }
+
+    // Returns false to abort the upload (malformed beyond recovery)
+    bool feed(const char* data, size_t len) {
+        if (format_ == Csv) {
+            if (csv_.feed(data, len, [this](const std::vector<std::string>& f, size_t line) { csv_record(f, line); })) {
+                return true;
+            }
+            fatal_ = "field longer than " + std::to_string(max_field) + " bytes at line " +
+                     std::to_string(csv_.line());
+            return false;
+        }
+
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] != '\n') {
+                line_buf_ += data[i];
+                if (line_buf_.size() > 2 * max_field) {
+                    fatal_ = "line " + std::to_string(ndjson_line_) + " is too long";
+                    return false;
+                }
+                continue;
+            }
+            ndjson_record();
+        }
+        return true;
+    }
+
+    void finish() {
+        if (fatal_.empty()) {
+            if (format_ == Csv) {
+                csv_.finish([this](const std::vector<std::string>& f, size_t line) { csv_record(f, line); });
+            } else if (!line_buf_.empty()) {
+                ndjson_record();
+            }
+        }
+        flush();
+    }
+
+    size_t imported() const { return imported_; }
+
+    std::string result_json() const {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("imported", static_cast<long long>(imported_));
+        w.field("rejected", static_cast<long long>(rejected_));
+        w.key("errors");
+        w.begin_array();
+        for (const auto& e : errors_) {
+            w.begin_object();
+            w.field("line", static_cast<long long>(e.first));
+            w.field("error", e.second);
+            w.end_object();
+        }
+        w.end_array();
+        if (!fatal_.empty()) w.field("aborted", fatal_);
+        w.key("seconds");
+        w.value(secs, 3);
+        w.key("rows_per_second");
+        w.value(secs > 0 ? imported_ / secs : 0.0, 0);
+        w.end_object();
+        return out;
+    }
+
+private:
+    void csv_record(const std::vector<std::string>& fields, size_t line) {
+        if (!header_checked_) {
+            header_checked_ = true;
+            if (lower(fields[0]) == "name") {
+                name_col_ = 0;
+                feedback_col_ = -1;
+                for (size_t i = 0; i < fields.size(); i++) {
+                    std::string h = lower(fields[i]);
+                    if (h == "name") name_col_ = static_cast<int>(i);
+                    if (h == "student_feedback" || h == "feedback") feedback_col_ = static_cast<int>(i);
+                }
+                return;
+            }
+        }
+        add(column(fields, name_col_), column(fields, feedback_col_), line);
+    }
+
+    void ndjson_record() {
+        size_t line = ndjson_line_++;
+        if (!line_buf_.empty() && line_buf_.back() == '\r') line_buf_.pop_back();
+        if (line_buf_.find_first_not_of(" \t") == std::string::npos) {
+            line_buf_.clear();
+            return;
+        }
+        JsonValue v;
+        if (!json_parse(line_buf_, v) || v.type != JsonValue::Object) {
+            reject(line, "not a JSON object");
+        } else {
+            add(v.get_string("name"), v.get_string("student_feedback"), line);
+        }
+        line_buf_.clear();
+    }
+
+    void add(std::string name, std::string feedback, size_t line) {
+        if (name.find_first_not_of(" \t") == std::string::npos) {
+            reject(line, "name is required");
+            return;
+        }
+        batch_bytes_used_ += name.size() + feedback.size();
+        batch_.push_back({std::move(name), std::move(feedback)});
+        if (batch_.size() >= batch_rows || batch_bytes_used_ >= batch_bytes) flush();
+    }
+
+    void reject(size_t line, const char* message) {
+        rejected_++;
+        if (errors_.size() < max_errors) errors_.emplace_back(line, message);
+    }
+
+    void flush() {
+        if (batch_.empty()) return;
+        imported_ += db_.create_candidates(position_id_, batch_);
+        batch_.clear();
+        batch_bytes_used_ = 0;
+    }
+
+    static std::string column(const std::vector<std::string>& fields, int col) {
+        return col >= 0 && static_cast<size_t>(col) < fields.size() ? fields[col] : std::string();
+    }
+
+    static std::string lower(std::string s) {
+        for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return s;
+    }
+
+    Database& db_;
+    std::string position_id_;
+    Format format_;
+    CsvReader csv_;
+    bool header_checked_ = false;
+    int name_col_ = 0;
+    int feedback_col_ = 1;
+    std::string line_buf_;
+    size_t ndjson_line_ = 1;
+    std::vector<NewCandidate> batch_;
+    size_t batch_bytes_used_ = 0;
+    size_t imported_ = 0;
+    size_t rejected_ = 0;
+    std::vector<std::pair<size_t, std::string>> errors_;
+    std::string fatal_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // IMPORT_H
@@ -0,0 +1,367 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+inline bool json_needs_escape(char c) {
+    return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+// Length of the prefix of s that can be copied without escaping. With SSE2
+// this checks 16 bytes per step; most strings are clean and finish here.
+inline size_t json_clean_prefix(const char* s, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        // Unsigned c <= 0x1f is max(c, 0x1f) == 0x1f
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        int mask = _mm_movemask_epi8(special);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+    while (i < n && !json_needs_escape(s[i])) i++;
+    return i;
+}
+
+// Append s to out as the body of a JSON string literal (no surrounding quotes)
+inline void json_escape(std::string& out, std::string_view s) {
+    static const char* hex = "0123456789abcdef";
+    const char* p = s.data();
+    size_t n = s.size();
+    while (n) {
+        size_t run = json_clean_prefix(p, n);
+        out.append(p, run);
+        p += run;
+        n -= run;
+        if (!n) break;
+        char c = *p++;
+        n--;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[(c >> 4) & 0xf];
+                out += hex[c & 0xf];
+        }
+    }
+}
+
+// Streaming JSON writer appending to a caller-owned string. Commas are
+// tracked with a fixed bit stack, so nothing is allocated beyond the growth
+// of out itself. Keys and values are written as given; callers keep the
+// begin/end calls balanced and nest at most 64 levels.
+//
+//   JsonWriter w(out);
+//   w.begin_object();
+//   w.key("id"); w.value(id);
+//   w.key("scores"); w.begin_array(); w.value(3); w.end_array();
+//   w.end_object();
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    void begin_object() { open('{'); }
+    void end_object() { close('}'); }
+    void begin_array() { open('['); }
+    void end_array() { close(']'); }
+
+    void key(std::string_view k) {
+        separate();
+        out_ += '"';
+        json_escape(out_, k);
+        out_ += "\":";
+        after_key_ = true;
+    }
+
+    void value(std::string_view v) {
+        separate();
+        out_ += '"';
+        json_escape(out_, v);
+        out_ += '"';
+    }
+    void value(const char* v) { value(std::string_view(v)); }
+    void value(const std::string& v) { value(std::string_view(v)); }
+
+    void value(long long v) {
+        separate();
+        char buf[24];
+        out_.append(buf, snprintf(buf, sizeof(buf), "%lld", v));
+    }
+    void value(int v) { value(static_cast<long long>(v)); }
+    void value(long v) { value(static_cast<long long>(v)); }
+
+    // Fixed-point number; scores are only meaningful to a couple of places
+    void value(double v, int decimals = 2) {
+        separate();
+        char buf[48];
+        out_.append(buf, snprintf(buf, sizeof(buf), "%.*f", decimals, v));
+    }
+
+    void value(bool v) {
+        separate();
+        out_ += v ? "true" : "false";
+    }
+
+    void null() {
+        separate();
+        out_ += "null";
+    }
+
+    // Pre-serialised JSON, e.g. a cached fragment
+    void raw(std::string_view json) {
+        separate();
+        out_ += json;
+    }
+
+    template <typename T>
+    void field(std::string_view k, const T& v) {
+        key(k);
+        value(v);
+    }
+
+private:
+    void separate() {
+        if (after_key_) {
+            after_key_ = false;
+        } else if (depth_ > 0) {
+            uint64_t bit = uint64_t(1) << (depth_ - 1);
+            if (has_items_ & bit) out_ += ',';
+            has_items_ |= bit;
+        }
+    }
+
+    void open(char c) {
+        separate();
+        out_ += c;
+        depth_++;
+        has_items_ &= ~(uint64_t(1) << (depth_ - 1));
+    }
+
+    void close(char c) {
+        depth_--;
+        out_ += c;
+    }
+
+    std::string& out_;
+    uint64_t has_items_ = 0;
+    int depth_ = 0;
+    bool after_key_ = false;
+};
+
+// Parsed JSON document. Objects keep their members in document order.
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Null;
+    bool boolean = false;
+    double number = 0;
+    std::string str;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* get(std::string_view key) const {
+        for (const auto& m : members) {
+            if (m.first == key) return &m.second;
+        }
+        return nullptr;
+    }
+
+    std::string get_string(std::string_view key, const std::string& fallback = "") const {
+        const JsonValue* v = get(key);
+        return v && v->type == String ? v->str : fallback;
+    }
+
+    double get_number(std::string_view key, double fallback = 0) const {
+        const JsonValue* v = get(key);
+        return v && v->type == Number ? v->number : fallback;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : s_(text) {}
+
+    bool parse(JsonValue& out) {
+        if (!value(out, 0)) return false;
+        skip_ws();
+        return pos_ == s_.size();
+    }
+
+private:
+    static constexpr int max_depth = 64;
+
+    void skip_ws() {
+        while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\n' || s_[pos_] == '\r')) pos_++;
+    }
+
+    bool literal(std::string_view word) {
+        if (s_.substr(pos_, word.size()) != word) return false;
+        pos_ += word.size();
+        return true;
+    }
+
+    bool value(JsonValue& out, int depth) {
+        if (depth > max_depth) return false;
+        skip_ws();
+        if (pos_ >= s_.size()) return false;
+        char c = s_[pos_];
+        if (c == '{') return object(out, depth);
+        if (c == '[') return array(out, depth);
+        if (c == '"') { out.type = JsonValue::String; return string(out.str); }
+        if (c == 't') { out.type = JsonValue::Bool; out.boolean = true; return literal("true"); }
+        if (c == 'f') { out.type = JsonValue::Bool; out.boolean = false; return literal("false"); }
+        if (c == 'n') { out.type = JsonValue::Null; return literal("null"); }
+        return number(out);
+    }
+
+    bool object(JsonValue& out, int depth) {
+        out.type = JsonValue::Object;
+        pos_++;
+        skip_ws();
+        if (pos_ < s_.size() && s_[pos_] == '}') { pos_++; return true; }
+        while (true) {
+            skip_ws();
+            std::string key;
+            if (pos_ >= s_.size() || s_[pos_] != '"' || !string(key)) return false;
+            skip_ws();
+            if (pos_ >= s_.size() || s_[pos_++] != ':') return false;
+            out.members.emplace_back(std::move(key), JsonValue());
+            if (!value(out.members.back().second, depth + 1)) return false;
+            skip_ws();
+            if (pos_ >= s_.size()) return false;
+            if (s_[pos_] == ',') { pos_++; continue; }
+            if (s_[pos_] == '}') { pos_++; return true; }
+            return false;
+        }
+    }
+
+    bool array(JsonValue& out, int depth) {
+        out.type = JsonValue::Array;
+        pos_++;
+        skip_ws();
+        if (pos_ < s_.size() && s_[pos_] == ']') { pos_++; return true; }
+        while (true) {
+            out.items.emplace_back();
+            if (!value(out.items.back(), depth + 1)) return false;
+            skip_ws();
+            if (pos_ >= s_.size()) return false;
+            if (s_[pos_] == ',') { pos_++; continue; }
+            if (s_[pos_] == ']') { pos_++; return true; }
+            return false;
+        }
+    }
+
+    bool number(JsonValue& out) {
+        size_t start = pos_;
+        if (pos_ < s_.size() && s_[pos_] == '-') pos_++;
+        while (pos_ < s_.size() && (isdigit_(s_[pos_]) || s_[pos_] == '.' || s_[pos_] == 'e' ||
+                                    s_[pos_] == 'E' || s_[pos_] == '+' || s_[pos_] == '-')) pos_++;
+        if (pos_ == start) return false;
+        std::string digits(s_.substr(start, pos_ - start));
+        char* end = nullptr;
+        out.type = JsonValue::Number;
+        out.number = std::strtod(digits.c_str(), &end);
+        return end && *end == '\0';
+    }
+
+    static bool isdigit_(char c) { return c >= '0' && c <= '9'; }
+
+    bool hex4(unsigned& cp) {
+        if (pos_ + 4 > s_.size()) return false;
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char h = s_[pos_++];
+            cp <<= 4;
+            if (h >= '0' && h <= '9') cp |= h - '0';
+            else if (h >= 'a' && h <= 'f') cp |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F') cp |= h - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xc0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xe0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    }
+
+    bool string(std::string& out) {
+        pos_++;  // opening quote
+        while (pos_ < s_.size()) {
+            char c = s_[pos_++];
+            if (c == '"') return true;
+            if (c != '\\') { out += c; continue; }
+            if (pos_ >= s_.size()) return false;
+            char e = s_[pos_++];
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if (!hex4(cp)) return false;
+                    // A high surrogate must be followed by a low one; a lone
+                    // surrogate has no UTF-8 encoding
+                    if (cp >= 0xdc00 && cp < 0xe000) return false;
+                    if (cp >= 0xd800 && cp < 0xdc00) {
+                        if (s_.substr(pos_, 2) != "\\u") return false;
+                        pos_ += 2;
+                        unsigned low;
+                        if (!hex4(low) || low < 0xdc00 || low >= 0xe000) return false;
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    std::string_view s_;
+    size_t pos_ = 0;
+};
+
+inline bool json_parse(std::string_view text, JsonValue& out) {
+    return JsonParser(text).parse(out);
+}
+
+#endif // JSON_H
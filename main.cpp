@@ -1,384 +1,324 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <random>
 #include <sstream>
 #include <iomanip>
-#include <sqlite3.h>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <charconv>
 #include "httplib.h"
 #include "templates.h"
+#include "database.h"
+#include "form.h"
+#include "trace.h"
+#include "capture.h"
+#include "ranking_hub.h"
+#include "import.h"
+#include "export.h"
+#include "feedback.h"
+#include "backup.h"
+#include "follower.h"
+#include "tenants.h"
+
+// Positions per page on the home page
+const int positions_page_size = 50;
+
+// Most scores accepted by one POST /api/v1/scores
+const size_t score_batch_limit = 500;
+
+// Most change-log entries returned by one /api/changes call
+const int changes_page_size = 1000;
+
+// Results shown by /search and /api/v1/search
+const int search_results_limit = 20;
 
-// Generate a UUID
-std::string generate_uuid() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
-    static const char* hex = "0123456789abcdef";
+// Get current user from headers (SSO) or defaults
+struct User {
+    std::string id;
+    std::string email;
+    std::string name;
+};
 
-    std::string uuid = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
-    for (char& c : uuid) {
-        if (c == 'x') {
-            c = hex[dis(gen)];
-        } else if (c == 'y') {
-            c = hex[(dis(gen) & 0x3) | 0x8];
-        }
-    }
-    return uuid;
-}
+// Requests without SSO headers act as this user (development)
+const char* const dev_user_id = "dev-user-1";
 
-// URL decode
-std::string url_decode(const std::string& s) {
-    std::string result;
-    for (size_t i = 0; i < s.length(); i++) {
-        if (s[i] == '%' && i + 2 < s.length()) {
-            int val;
-            std::istringstream iss(s.substr(i + 1, 2));
-            if (iss >> std::hex >> val) {
-                result += static_cast<char>(val);
-                i += 2;
-            } else {
-                result += s[i];
-            }
-        } else if (s[i] == '+') {
-            result += ' ';
-        } else {
-            result += s[i];
-        }
+User get_current_user(const httplib::Request& req, Database& db) {
+    TRACE_SCOPE("get_current_user");
+    User user;
+    user.id = req.get_header_value("X-SSO-User-ID");
+    user.email = req.get_header_value("X-SSO-Email");
+    user.name = req.get_header_value("X-SSO-Name");
+
+    // Development fallback
+    if (user.id.empty()) {
+        user.id = dev_user_id;
+        user.email = "dev@university.edu";
+        user.name = "Dev User";
     }
-    return result;
+
+    db.ensure_user(user.id, user.email, user.name);
+    return user;
 }
 
-// Parse form data
-std::map<std::string, std::string> parse_form(const std::string& body) {
-    std::map<std::string, std::string> params;
-    std::istringstream stream(body);
-    std::string pair;
-    while (std::getline(stream, pair, '&')) {
-        size_t pos = pair.find('=');
-        if (pos != std::string::npos) {
-            std::string key = url_decode(pair.substr(0, pos));
-            std::string value = url_decode(pair.substr(pos + 1));
-            params[key] = value;
-        }
-    }
-    return params;
+// The caller's faculty (see tenants.h); checked by the pre-routing handler
+std::shared_ptr<Tenant> get_tenant(const httplib::Request& req, TenantPool& tenants) {
+    return tenants.get(req.get_header_value("X-SSO-Faculty"));
 }
 
-// Database wrapper
-class Database {
+// Task queue that records how long each accepted connection waited for a worker
+class TracingTaskQueue : public httplib::TaskQueue {
 public:
-    sqlite3* db;
-
-    Database(const std::string& path) {
-        if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
-            throw std::runtime_error("Failed to open database");
-        }
-        sqlite3_exec(db, "PRAGMA foreign_keys = ON", nullptr, nullptr, nullptr);
-        init_schema();
+    explicit TracingTaskQueue(size_t threads) : pool_(threads) {}
+
+    bool enqueue(std::function<void()> fn) override {
+        uint64_t accepted = Tracer::now_ns();
+        return pool_.enqueue([fn = std::move(fn), accepted]() {
+            Tracer::instance().record("accept", accepted, Tracer::now_ns());
+            fn();
+        });
     }
 
-    void init_schema() {
-        const char* schema = R"(
-            CREATE TABLE IF NOT EXISTS users (
-                id TEXT PRIMARY KEY,
-                email TEXT NOT NULL UNIQUE,
-                display_name TEXT NOT NULL,
-                created_at TEXT NOT NULL DEFAULT (datetime('now'))
-            );
-
-            CREATE TABLE IF NOT EXISTS positions (
-                id TEXT PRIMARY KEY,
-                title TEXT NOT NULL,
-                created_by TEXT NOT NULL REFERENCES users(id),
-                created_at TEXT NOT NULL DEFAULT (datetime('now'))
-            );
-
-            CREATE TABLE IF NOT EXISTS candidates (
-                id TEXT PRIMARY KEY,
-                position_id TEXT NOT NULL REFERENCES positions(id) ON DELETE CASCADE,
-                name TEXT NOT NULL,
-                student_feedback TEXT,
-                created_at TEXT NOT NULL DEFAULT (datetime('now'))
-            );
-
-            CREATE TABLE IF NOT EXISTS scores (
-                id TEXT PRIMARY KEY,
-                candidate_id TEXT NOT NULL REFERENCES candidates(id) ON DELETE CASCADE,
-                interviewer_id TEXT NOT NULL REFERENCES users(id),
-                hand_gestures INTEGER NOT NULL CHECK (hand_gestures BETWEEN 1 AND 5),
-                stayed_awake INTEGER NOT NULL CHECK (stayed_awake BETWEEN 1 AND 5),
-                created_at TEXT NOT NULL DEFAULT (datetime('now')),
-                updated_at TEXT NOT NULL DEFAULT (datetime('now')),
-                UNIQUE (candidate_id, interviewer_id)
-            );
-
-            CREATE INDEX IF NOT EXISTS idx_candidates_position ON candidates(position_id);
-            CREATE INDEX IF NOT EXISTS idx_scores_candidate ON scores(candidate_id);
-            CREATE INDEX IF NOT EXISTS idx_scores_interviewer ON scores(interviewer_id);
-            CREATE INDEX IF NOT EXISTS idx_positions_created_by ON positions(created_by);
-        )";
-
-        char* err_msg = nullptr;
-        if (sqlite3_exec(db, schema, nullptr, nullptr, &err_msg) != SQLITE_OK) {
-            std::string error = err_msg ? err_msg : "Unknown error";
-            sqlite3_free(err_msg);
-            throw std::runtime_error("Failed to initialize schema: " + error);
-        }
-    }
+    void shutdown() override { pool_.shutdown(); }
 
-    ~Database() {
-        sqlite3_close(db);
-    }
+private:
+    httplib::ThreadPool pool_;
+};
 
-    void ensure_user(const std::string& id, const std::string& email, const std::string& name) {
-        const char* sql = "INSERT OR IGNORE INTO users (id, email, display_name) VALUES (?, ?, ?)";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, email.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
+// Hook request lifecycle spans into the server: header parse ends when the
+// pre-routing handler runs, route match (including body read) when the
+// pre-request handler runs, and the whole request when the logger fires
+// after the response has been written. The logger also feeds the optional
+// request capture. /admin/* is limited to the SSO users in admins before
+// routing, a read-only follower turns away writes there, and with tenancy
+// on a malformed X-SSO-Faculty is rejected there too.
+void install_request_hooks(httplib::Server& svr, RequestCapture* capture, bool read_only, bool tenancy,
+                           std::vector<std::string> admins) {
+    static thread_local uint64_t routing_start_ns = 0;
+
+    // Each open event stream holds a worker for its whole lifetime, so leave
+    // room for RankingHub::max_watchers of them (counted across every
+    // faculty's hub) on top of the normal pool.
+    svr.new_task_queue = [] {
+        return new TracingTaskQueue(CPPHTTPLIB_THREAD_POOL_COUNT + RankingHub::max_watchers);
+    };
+
+    svr.set_pre_routing_handler([read_only, tenancy, admins](const httplib::Request& req, httplib::Response& res) {
+        Tracer& tracer = Tracer::instance();
+        Tracer::current_request() = tracer.next_request_id();
+        routing_start_ns = Tracer::now_ns();
+        tracer.record("parse_headers", Tracer::to_ns(req.start_time_), routing_start_ns);
+        if (req.path.rfind("/admin/", 0) == 0) {
+            std::string user = req.get_header_value("X-SSO-User-ID");
+            if (user.empty()) user = dev_user_id;
+            if (std::find(admins.begin(), admins.end(), user) == admins.end()) {
+                res.status = 403;
+                res.set_content(api_error_json("admin endpoints are limited to CANDIDATE_SCORING_ADMINS"),
+                                "application/json");
+                return httplib::Server::HandlerResponse::Handled;
+            }
+        }
+        // Backups and vacuum passes leave the rows alone, so a follower
+        // still takes those; archiving would delete what it replicated
+        if (read_only && req.method != "GET" && req.method != "HEAD" && req.path != "/admin/backup" &&
+            req.path != "/admin/vacuum") {
+            res.status = 403;
+            res.set_content(api_error_json("this server is a read-only follower; send writes to the primary"),
+                            "application/json");
+            return httplib::Server::HandlerResponse::Handled;
+        }
+        std::string faculty = req.get_header_value("X-SSO-Faculty");
+        if (tenancy && !faculty.empty() && !TenantPool::valid_name(faculty)) {
+            res.status = 400;
+            res.set_content(api_error_json("X-SSO-Faculty must be 1 to 64 lower-case letters, digits, '-' or '_', "
+                                           "not ending in -archive"),
+                            "application/json");
+            return httplib::Server::HandlerResponse::Handled;
+        }
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
 
-    std::vector<Position> get_positions() {
-        std::vector<Position> positions;
-        const char* sql = R"(
-            SELECT p.id, p.title, u.display_name, COUNT(DISTINCT c.id) as cnt
-            FROM positions p
-            JOIN users u ON p.created_by = u.id
-            LEFT JOIN candidates c ON c.position_id = p.id
-            GROUP BY p.id
-            ORDER BY p.created_at DESC
-        )";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            Position p;
-            p.id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            p.title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            p.creator_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-            p.candidate_count = sqlite3_column_int(stmt, 3);
-            positions.push_back(p);
-        }
-        sqlite3_finalize(stmt);
-        return positions;
-    }
+    svr.set_pre_request_handler([](const httplib::Request& req, httplib::Response&) {
+        Tracer::instance().record("route_match", routing_start_ns, Tracer::now_ns(), req.matched_route);
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
 
-    std::string create_position(const std::string& title, const std::string& user_id) {
-        std::string id = generate_uuid();
-        const char* sql = "INSERT INTO positions (id, title, created_by) VALUES (?, ?, ?)";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, title.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, user_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        return id;
-    }
+    svr.set_logger([capture](const httplib::Request& req, const httplib::Response& res) {
+        Tracer::instance().record("request", Tracer::to_ns(req.start_time_), Tracer::now_ns(),
+                                  req.method + " " + req.path);
+        Tracer::current_request() = 0;
+        if (capture) capture->record(req, res);
+    });
+}
 
-    bool get_position(const std::string& id, std::string& title) {
-        const char* sql = "SELECT title FROM positions WHERE id = ?";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-        bool found = sqlite3_step(stmt) == SQLITE_ROW;
-        if (found) {
-            title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
-        return found;
+int main() {
+    // CANDIDATE_SCORING_DB and CANDIDATE_SCORING_PORT let a follower run
+    // alongside its primary on one box
+    const char* db_path = std::getenv("CANDIDATE_SCORING_DB");
+    const char* port_env = std::getenv("CANDIDATE_SCORING_PORT");
+    const char* primary = std::getenv("CANDIDATE_SCORING_FOLLOW");
+    int port = port_env ? std::atoi(port_env) : 5000;
+    // CANDIDATE_SCORING_TENANT_DIR gives each faculty its own database there
+    // (tenants.h), keeping up to CANDIDATE_SCORING_TENANT_CACHE of them open
+    const char* tenant_dir = std::getenv("CANDIDATE_SCORING_TENANT_DIR");
+    const char* tenant_cache = std::getenv("CANDIDATE_SCORING_TENANT_CACHE");
+    if (primary && tenant_dir) {
+        std::cerr << "A follower replicates one database; unset CANDIDATE_SCORING_TENANT_DIR" << std::endl;
+        return 1;
     }
-
-    std::vector<CandidateRanking> get_candidates_for_position(const std::string& position_id) {
-        std::vector<CandidateRanking> candidates;
-        const char* sql = R"(
-            SELECT c.id, c.name, COUNT(s.id), AVG(s.hand_gestures), AVG(s.stayed_awake),
-                   (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2
-            FROM candidates c
-            LEFT JOIN scores s ON c.id = s.candidate_id
-            WHERE c.position_id = ?
-            GROUP BY c.id
-            ORDER BY (AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2 DESC NULLS LAST, c.name
-        )";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, position_id.c_str(), -1, SQLITE_TRANSIENT);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            CandidateRanking c;
-            c.id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            c.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            c.num_scores = sqlite3_column_int(stmt, 2);
-            c.avg_hand_gestures = sqlite3_column_type(stmt, 3) != SQLITE_NULL ? sqlite3_column_double(stmt, 3) : 0;
-            c.avg_stayed_awake = sqlite3_column_type(stmt, 4) != SQLITE_NULL ? sqlite3_column_double(stmt, 4) : 0;
-            c.avg_total = sqlite3_column_type(stmt, 5) != SQLITE_NULL ? sqlite3_column_double(stmt, 5) : 0;
-            candidates.push_back(c);
-        }
-        sqlite3_finalize(stmt);
-        return candidates;
+    TenantPool tenants(db_path ? db_path : "candidate_scoring.db", tenant_dir ? tenant_dir : "",
+                       std::max(1, tenant_cache ? std::atoi(tenant_cache) : 32));
+    // The default tenant: requests without a faculty, and replication
+    std::shared_ptr<Tenant> main_tenant = tenants.fallback();
+    Database& db = main_tenant->db;
+    RankingHub& hub = main_tenant->hub;
+    db.replica = primary != nullptr;
+    // It stays open for the whole run; check for free pages from the start
+    main_tenant->vacuum.wake();
+    std::cout << "Database ready in " << db.open_ms << " ms (schema version "
+              << Database::schema_version << ", was " << db.found_version << ")" << std::endl;
+    httplib::Server svr;
+    // Headers and body go out in separate writes; without TCP_NODELAY every
+    // keep-alive response waits on the client's delayed ACK (~40ms).
+    svr.set_tcp_nodelay(true);
+
+    // CANDIDATE_SCORING_CAPTURE=requests.jsonl records traffic for ./replay
+    std::unique_ptr<RequestCapture> capture;
+    if (const char* capture_path = std::getenv("CANDIDATE_SCORING_CAPTURE")) {
+        capture.reset(new RequestCapture(capture_path));
+        if (!capture->is_open()) {
+            std::cerr << "Cannot open capture file " << capture_path << std::endl;
+            return 1;
+        }
     }
-
-    std::string create_candidate(const std::string& position_id, const std::string& name) {
-        std::string id = generate_uuid();
-        const char* sql = "INSERT INTO candidates (id, position_id, name) VALUES (?, ?, ?)";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, position_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        return id;
+    // CANDIDATE_SCORING_ADMINS: comma-separated SSO user ids allowed to use
+    // /admin/*; nobody when unset
+    std::vector<std::string> admins;
+    if (const char* admins_env = std::getenv("CANDIDATE_SCORING_ADMINS")) {
+        std::stringstream list(admins_env);
+        std::string id;
+        while (std::getline(list, id, ',')) {
+            if (!id.empty()) admins.push_back(id);
+        }
     }
+    install_request_hooks(svr, capture.get(), db.replica, tenants.enabled(), std::move(admins));
 
-    bool get_candidate(const std::string& id, CandidateDetail& candidate) {
-        const char* sql = R"(
-            SELECT c.id, c.name, c.position_id, p.title, COALESCE(c.student_feedback, '')
-            FROM candidates c
-            JOIN positions p ON c.position_id = p.id
-            WHERE c.id = ?
-        )";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-        bool found = sqlite3_step(stmt) == SQLITE_ROW;
-        if (found) {
-            candidate.id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            candidate.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            candidate.position_id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-            candidate.position_title = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-            candidate.student_feedback = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        }
-        sqlite3_finalize(stmt);
-        return found;
-    }
+    // Follower mode: apply the primary's change log, serve reads only
+    std::unique_ptr<Follower> follower;
+    if (primary) follower.reset(new Follower(db, hub, primary));
 
-    ScoreStats get_score_stats(const std::string& candidate_id) {
-        ScoreStats stats = {0, 0, 0, 0};
-        const char* sql = R"(
-            SELECT COUNT(*), AVG(hand_gestures), AVG(stayed_awake),
-                   (AVG(hand_gestures) + AVG(stayed_awake)) / 2
-            FROM scores WHERE candidate_id = ?
-        )";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            stats.num_scores = sqlite3_column_int(stmt, 0);
-            if (stats.num_scores > 0) {
-                stats.avg_hand_gestures = sqlite3_column_double(stmt, 1);
-                stats.avg_stayed_awake = sqlite3_column_double(stmt, 2);
-                stats.avg_total = sqlite3_column_double(stmt, 3);
-            }
-        }
-        sqlite3_finalize(stmt);
-        return stats;
-    }
+    // Replication role, and on a follower how far behind the primary it is
+    svr.Get("/admin/replication", [&follower](const httplib::Request&, httplib::Response& res) {
+        res.set_content(follower ? follower->status_json() : "{\"role\":\"primary\"}", "application/json");
+    });
 
-    MyScore get_my_score(const std::string& candidate_id, const std::string& user_id) {
-        MyScore score = {false, 0, 0};
-        const char* sql = "SELECT hand_gestures, stayed_awake FROM scores WHERE candidate_id = ? AND interviewer_id = ?";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, user_id.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            score.exists = true;
-            score.hand_gestures = sqlite3_column_int(stmt, 0);
-            score.stayed_awake = sqlite3_column_int(stmt, 1);
-        }
-        sqlite3_finalize(stmt);
-        return score;
-    }
+    // Open faculty databases and the handle cache's hit rate
+    svr.Get("/admin/tenants", [&tenants](const httplib::Request&, httplib::Response& res) {
+        res.set_content(tenants.status_json(), "application/json");
+    });
 
-    void upsert_score(const std::string& candidate_id, const std::string& user_id, int hand_gestures, int stayed_awake) {
-        // Check if exists
-        MyScore existing = get_my_score(candidate_id, user_id);
-        if (existing.exists) {
-            const char* sql = "UPDATE scores SET hand_gestures = ?, stayed_awake = ?, updated_at = datetime('now') WHERE candidate_id = ? AND interviewer_id = ?";
-            sqlite3_stmt* stmt;
-            sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-            sqlite3_bind_int(stmt, 1, hand_gestures);
-            sqlite3_bind_int(stmt, 2, stayed_awake);
-            sqlite3_bind_text(stmt, 3, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 4, user_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
-        } else {
-            std::string id = generate_uuid();
-            const char* sql = "INSERT INTO scores (id, candidate_id, interviewer_id, hand_gestures, stayed_awake) VALUES (?, ?, ?, ?, ?)";
-            sqlite3_stmt* stmt;
-            sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, user_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt, 4, hand_gestures);
-            sqlite3_bind_int(stmt, 5, stayed_awake);
-            sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
-        }
-    }
+    // Online backups of the default and every faculty database into
+    // CANDIDATE_SCORING_BACKUP_DIR (default backups/), every
+    // CANDIDATE_SCORING_BACKUP_MINUTES if set, or on POST /admin/backup
+    const char* backup_dir = std::getenv("CANDIDATE_SCORING_BACKUP_DIR");
+    const char* backup_minutes = std::getenv("CANDIDATE_SCORING_BACKUP_MINUTES");
+    BackupJob backups(db, tenants, backup_dir ? backup_dir : "backups",
+                      std::chrono::minutes(backup_minutes ? std::atoi(backup_minutes) : 0));
+
+    // Chrome trace JSON of recent request spans (load in chrome://tracing or Perfetto)
+    svr.Get("/admin/trace", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(Tracer::instance().export_chrome_json(), "application/json");
+    });
 
-    void update_feedback(const std::string& candidate_id, const std::string& feedback) {
-        const char* sql = "UPDATE candidates SET student_feedback = ? WHERE id = ?";
-        sqlite3_stmt* stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-        sqlite3_bind_text(stmt, 1, feedback.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, candidate_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
-};
+    // Start a backup (202), or 409 if one is already under way
+    svr.Post("/admin/backup", [&backups](const httplib::Request&, httplib::Response& res) {
+        res.status = backups.start() ? 202 : 409;
+        res.set_content(backups.status_json(), "application/json");
+    });
 
-// Get current user from headers (SSO) or defaults
-struct User {
-    std::string id;
-    std::string email;
-    std::string name;
-};
+    // Progress of the current backup, or how the last one went
+    svr.Get("/admin/backup", [&backups](const httplib::Request&, httplib::Response& res) {
+        res.set_content(backups.status_json(), "application/json");
+    });
 
-User get_current_user(const httplib::Request& req, Database& db) {
-    User user;
-    user.id = req.get_header_value("X-SSO-User-ID");
-    user.email = req.get_header_value("X-SSO-Email");
-    user.name = req.get_header_value("X-SSO-Name");
+    // Archive the caller's faculty's closed positions now (202), or 409 if
+    // a pass is already under way
+    svr.Post("/admin/archive", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        res.status = tenant->archive.start() ? 202 : 409;
+        res.set_content(tenant->archive.status_json(), "application/json");
+    });
 
-    // Development fallback
-    if (user.id.empty()) {
-        user.id = "dev-user-1";
-        user.email = "dev@university.edu";
-        user.name = "Dev User";
-    }
+    // What the archive job has moved so far, and its longest lock hold
+    svr.Get("/admin/archive", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        res.set_content(tenant->archive.status_json(), "application/json");
+    });
 
-    db.ensure_user(user.id, user.email, user.name);
-    return user;
-}
+    // Release the caller's faculty's free pages now (202), even while it is
+    // busy, or 409 if a pass is already under way
+    svr.Post("/admin/vacuum", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        res.status = tenant->vacuum.start() ? 202 : 409;
+        res.set_content(tenant->vacuum.status_json(), "application/json");
+    });
 
-int main() {
-    Database db("candidate_scoring.db");
-    httplib::Server svr;
+    // Free pages and fragmentation of each database, and pages released
+    svr.Get("/admin/vacuum", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        res.set_content(tenant->vacuum.status_json(), "application/json");
+    });
+
+    // Schema version, how long the database took to open, and the data
+    // migrations still running from the upgrade
+    svr.Get("/admin/schema", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("version", static_cast<long long>(Database::schema_version));
+        w.field("opened_at_version", static_cast<long long>(tenant->db.found_version));
+        w.key("open_ms");
+        w.value(tenant->db.open_ms, 3);
+        w.key("backfill");
+        w.raw(tenant->backfill.status_json());
+        w.end_object();
+        res.set_content(out, "application/json");
+    });
 
     // Home page - list positions
-    svr.Get("/", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Get("/", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
         User user = get_current_user(req, db);
-        auto positions = db.get_positions();
-        res.set_content(index_page(user.name, "", positions), "text/html");
+        std::string after = req.get_param_value("after");
+        if (after.find_first_not_of("0123456789abcdef-") != std::string::npos) after.clear();
+
+        TRACE_SCOPE("render.index_page");
+        res.set_content(index_page_rows(user.name, "", after, [&](auto&& emit) {
+            return db.for_each_position(after, positions_page_size, emit);
+        }), "text/html");
     });
 
     // New position form
-    svr.Get("/positions/new", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Get("/positions/new", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
         User user = get_current_user(req, db);
+        TRACE_SCOPE("render.position_form_page");
         res.set_content(position_form_page(user.name, ""), "text/html");
     });
 
     // Create position
-    svr.Post("/positions/new", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Post("/positions/new", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
         User user = get_current_user(req, db);
         auto params = parse_form(req.body);
         std::string title = params["title"];
 
         if (title.empty()) {
+            TRACE_SCOPE("render.position_form_page");
             res.set_content(position_form_page(user.name, "Position title is required."), "text/html");
             return;
         }
@@ -388,81 +328,528 @@ int main() {
     });
 
     // Position detail
-    svr.Get(R"(/positions/([a-f0-9-]+))", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Get(R"(/positions/([a-f0-9-]+))", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
         User user = get_current_user(req, db);
         std::string position_id = req.matches[1];
         std::string title;
+        bool closed;
 
-        if (!db.get_position(position_id, title)) {
+        if (!db.get_position(position_id, title, closed)) {
             res.set_redirect("/");
             return;
         }
 
-        auto candidates = db.get_candidates_for_position(position_id);
-        res.set_content(position_detail_page(user.name, "", position_id, title, candidates), "text/html");
+        TRACE_SCOPE("render.position_detail_page");
+        res.set_content(position_detail_page_rows(user.name, "", position_id, title, closed, [&](auto&& emit) {
+            db.for_each_candidate_ranking(position_id, emit);
+        }), "text/html");
     });
 
-    // New candidate form
-    svr.Get(R"(/positions/([a-f0-9-]+)/candidates/new)", [&db](const httplib::Request& req, httplib::Response& res) {
+    // Close a position: no more candidates, scores or feedback, and in a
+    // minute or so the archive job moves it out of the hot tables. Only the
+    // user who created it may.
+    svr.Post(R"(/positions/([a-f0-9-]+)/close)", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
         User user = get_current_user(req, db);
         std::string position_id = req.matches[1];
         std::string title;
+        bool closed;
+
+        if (!db.get_position(position_id, title, closed)) {
+            res.set_redirect("/");
+            return;
+        }
+        if (db.close_position(position_id, user.id)) {
+            tenant->archive.wake();
+            tenant->vacuum.wake();
+        } else if (!closed) {
+            res.status = 403;
+            TRACE_SCOPE("render.position_detail_page");
+            res.set_content(position_detail_page_rows(user.name, "Only the person who created this position can close it.",
+                                                      position_id, title, closed, [&](auto&& emit) {
+                db.for_each_candidate_ranking(position_id, emit);
+            }), "text/html");
+            return;
+        }
+        res.set_redirect("/positions/" + position_id, 303);
+    });
+
+    // Live ranking updates for the position page (Server-Sent Events)
+    svr.Get(R"(/positions/([a-f0-9-]+)/events)", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        RankingHub& hub = tenant->hub;
+        std::string position_id = req.matches[1];
+        std::string title;
+        uint64_t seen = 0;
 
         if (!db.get_position(position_id, title)) {
+            res.status = 404;
+            return;
+        }
+        if (!hub.subscribe(position_id, seen)) {
+            res.status = 503;
+            res.set_header("Retry-After", "30");
+            return;
+        }
+
+        // The stream holds its faculty's tenant open until it ends
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [tenant, position_id, seen](size_t, httplib::DataSink& sink) mutable {
+                std::string out;
+                // A comment line every 15s keeps proxies from timing the stream
+                // out and lets a failed write reveal a closed connection.
+                if (!tenant->hub.wait_events(position_id, seen, std::chrono::seconds(15), out)) out = ": keepalive\n\n";
+                return sink.write(out.data(), out.size());
+            },
+            [tenant, position_id](bool) { tenant->hub.unsubscribe(position_id); });
+    });
+
+    // Full-text search over candidate names, position titles and feedback
+    svr.Get("/search", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        User user = get_current_user(req, db);
+        std::string q = req.get_param_value("q");
+
+        TRACE_SCOPE("render.search_page");
+        res.set_content(search_page(user.name, q, [&](auto&& emit) {
+            db.search_candidates(q, search_results_limit, emit);
+        }), "text/html");
+    });
+
+    svr.Get("/api/v1/search", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string q = req.get_param_value("q");
+
+        TRACE_SCOPE("render.search_json");
+        res.set_content(search_json(q, [&](auto&& emit) {
+            db.search_candidates(q, search_results_limit, emit);
+        }), "application/json");
+    });
+
+    // Changes since a version, for clients that keep a local copy:
+    // GET /api/changes?since=0 first, then ?since=<version> from each reply.
+    svr.Get("/api/changes", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string since = req.get_param_value("since");
+        std::string limit = req.get_param_value("limit");
+        if (since.empty()) since = "0";
+        if (since.size() > 18 || since.find_first_not_of("0123456789") != std::string::npos ||
+            limit.size() > 4 || limit.find_first_not_of("0123456789") != std::string::npos) {
+            res.status = 400;
+            res.set_content(api_error_json("since and limit must be non-negative integers"), "application/json");
+            return;
+        }
+
+        ChangeSet changes;
+        int n = limit.empty() ? changes_page_size : std::min(std::max(std::atoi(limit.c_str()), 1), changes_page_size);
+        db.get_changes(std::stoll(since), n, changes);
+        res.set_content(changes_json(changes), "application/json");
+    });
+
+    // JSON mirrors of the pages for integrations, serialised straight from the
+    // database cursors (see api.h)
+    svr.Get("/api/v1/positions", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string after = req.get_param_value("after");
+        if (after.find_first_not_of("0123456789abcdef-") != std::string::npos) after.clear();
+
+        TRACE_SCOPE("render.positions_json");
+        res.set_content(positions_json([&](auto&& emit) {
+            return db.for_each_position(after, positions_page_size, emit);
+        }), "application/json");
+    });
+
+    svr.Get(R"(/api/v1/positions/([a-f0-9-]+))", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string position_id = req.matches[1];
+        std::string title;
+
+        if (!db.get_position(position_id, title)) {
+            res.status = 404;
+            res.set_content(api_error_json("position not found"), "application/json");
+            return;
+        }
+
+        TRACE_SCOPE("render.position_json");
+        res.set_content(position_json(position_id, title, [&](auto&& emit) {
+            db.for_each_candidate_ranking(position_id, emit);
+        }), "application/json");
+    });
+
+    svr.Get(R"(/api/v1/candidates/([a-f0-9-]+))", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        User user = get_current_user(req, db);
+        std::string candidate_id = req.matches[1];
+        CandidateDetail candidate;
+        ScoreStats stats;
+        MyScore my_score;
+
+        if (!db.get_candidate_detail(candidate_id, user.id, candidate, stats, my_score)) {
+            res.status = 404;
+            res.set_content(api_error_json("candidate not found"), "application/json");
+            return;
+        }
+
+        TRACE_SCOPE("render.candidate_json");
+        res.set_content(candidate_json(candidate, stats, my_score), "application/json");
+    });
+
+    svr.Get(R"(/api/v1/candidates/([a-f0-9-]+)/scores)", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string candidate_id = req.matches[1];
+        CandidateDetail candidate;
+
+        if (!db.get_candidate(candidate_id, candidate)) {
+            res.status = 404;
+            res.set_content(api_error_json("candidate not found"), "application/json");
+            return;
+        }
+
+        TRACE_SCOPE("render.scores_json");
+        res.set_content(scores_json(candidate_id, [&](auto&& emit) {
+            db.for_each_score(candidate_id, emit);
+        }), "application/json");
+    });
+
+    svr.Get(R"(/api/v1/candidates/([a-f0-9-]+)/feedback/revisions)",
+            [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string candidate_id = req.matches[1];
+        CandidateDetail candidate;
+
+        if (!db.get_candidate(candidate_id, candidate)) {
+            res.status = 404;
+            res.set_content(api_error_json("candidate not found"), "application/json");
+            return;
+        }
+
+        TRACE_SCOPE("render.feedback_revisions_json");
+        res.set_content(feedback_revisions_json(candidate_id, [&](auto&& emit) {
+            db.for_each_feedback_revision(candidate_id, emit);
+        }), "application/json");
+    });
+
+    // Score a whole shortlist at once; all entries are saved or none are
+    svr.Post("/api/v1/scores", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        RankingHub& hub = tenant->hub;
+        User user = get_current_user(req, db);
+        std::vector<ScoreSubmission> scores;
+        std::vector<BatchError> errors;
+
+        if (!parse_score_batch(req.body, score_batch_limit, scores, errors)) {
+            res.status = 400;
+            res.set_content(batch_errors_json(errors), "application/json");
+            return;
+        }
+
+        std::vector<ScoreResult> results;
+        std::vector<size_t> missing;
+        if (!db.upsert_scores(user.id, scores, results, missing)) {
+            for (size_t i : missing) errors.push_back({i, "candidate not found or position closed"});
+            if (errors.empty()) errors.push_back({0, "database error"});
+            res.status = missing.empty() ? 500 : 400;
+            res.set_content(batch_errors_json(errors), "application/json");
+            return;
+        }
+
+        for (const ScoreResult& r : results) hub.notify(r.position_id);
+        res.set_content(score_results_json(results), "application/json");
+    });
+
+    // New candidate form
+    svr.Get(R"(/positions/([a-f0-9-]+)/candidates/new)", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        User user = get_current_user(req, db);
+        std::string position_id = req.matches[1];
+        std::string title;
+        bool closed;
+
+        if (!db.get_position(position_id, title, closed)) {
             res.set_redirect("/");
             return;
         }
+        if (closed) {
+            res.set_redirect("/positions/" + position_id);
+            return;
+        }
 
+        TRACE_SCOPE("render.candidate_form_page");
         res.set_content(candidate_form_page(user.name, "", position_id, title), "text/html");
     });
 
     // Create candidate
-    svr.Post(R"(/positions/([a-f0-9-]+)/candidates/new)", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Post(R"(/positions/([a-f0-9-]+)/candidates/new)", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        RankingHub& hub = tenant->hub;
         User user = get_current_user(req, db);
         std::string position_id = req.matches[1];
         std::string title;
+        bool closed;
 
-        if (!db.get_position(position_id, title)) {
+        if (!db.get_position(position_id, title, closed)) {
             res.set_redirect("/");
             return;
         }
+        if (closed) {
+            res.set_redirect("/positions/" + position_id, 303);
+            return;
+        }
 
         auto params = parse_form(req.body);
         std::string name = params["name"];
 
         if (name.empty()) {
+            TRACE_SCOPE("render.candidate_form_page");
             res.set_content(candidate_form_page(user.name, "Candidate name is required.", position_id, title), "text/html");
             return;
         }
 
         std::string id = db.create_candidate(position_id, name);
+        hub.notify(position_id);
         res.set_redirect("/candidates/" + id);
     });
 
+    // Bulk import from CSV or NDJSON, read incrementally as it arrives:
+    //   curl --data-binary @applicants.csv -H 'Content-Type: text/csv' .../candidates/import
+    svr.Post(R"(/positions/([a-f0-9-]+)/candidates/import)",
+             [&tenants](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        RankingHub& hub = tenant->hub;
+        get_current_user(req, db);
+        std::string position_id = req.matches[1];
+        std::string title;
+        bool closed;
+
+        if (!db.get_position(position_id, title, closed)) {
+            res.status = 404;
+            res.set_content(api_error_json("position not found"), "application/json");
+            return;
+        }
+        if (closed) {
+            res.status = 409;
+            res.set_content(api_error_json("position is closed"), "application/json");
+            return;
+        }
+
+        std::string type = req.get_header_value("Content-Type");
+        std::string format = req.get_param_value("format");
+        bool ndjson = format == "ndjson" ||
+                      (format.empty() && (type.find("ndjson") != std::string::npos ||
+                                          type.find("jsonl") != std::string::npos));
+        CandidateImport import(db, position_id, ndjson ? CandidateImport::Ndjson : CandidateImport::Csv);
+
+        bool complete = reader([&](const char* data, size_t len) { return import.feed(data, len); });
+        import.finish();
+        if (import.imported() > 0) hub.notify(position_id);
+
+        if (!complete) res.status = 400;
+        res.set_content(import.result_json(), "application/json");
+    });
+
+    // Every position's rankings for HR: CSV, or NDJSON with ?format=ndjson.
+    // Gzipped on the fly when the client accepts it (curl --compressed).
+    svr.Get("/export/rankings", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        bool ndjson = req.get_param_value("format") == "ndjson";
+        auto exporter = std::make_shared<RankingExport>(
+            sqlite3_db_filename(db.db, "main"), db.has_archive ? sqlite3_db_filename(db.db, "archive") : "",
+            ndjson ? RankingExport::Ndjson : RankingExport::Csv);
+        if (!exporter->ok()) {
+            res.status = 500;
+            res.set_content("Export unavailable", "text/plain");
+            return;
+        }
+
+        std::shared_ptr<GzipStream> gzip;
+        if (req.get_header_value("Accept-Encoding").find("gzip") != std::string::npos) {
+            gzip = std::make_shared<GzipStream>();
+            res.set_header("Content-Encoding", "gzip");
+        }
+        res.set_header("Content-Disposition", ndjson ? "attachment; filename=\"rankings.ndjson\""
+                                                     : "attachment; filename=\"rankings.csv\"");
+        res.set_chunked_content_provider(ndjson ? "application/x-ndjson" : "text/csv",
+            [exporter, gzip](size_t, httplib::DataSink& sink) {
+                std::string rows, out;
+                bool more = exporter->next_chunk(rows);
+                if (gzip) {
+                    if (!gzip->write(rows, out, !more)) return false;
+                } else {
+                    out.swap(rows);
+                }
+                if (!out.empty() && !sink.write(out.data(), out.size())) return false;
+                if (!more) sink.done();
+                return true;
+            });
+    });
+
+    // Feedback documents of any length, streamed into and out of the
+    // candidate_feedback blob (form posts are capped at 8 KB by httplib):
+    //   curl -T report.txt .../candidates/<id>/feedback
+    // POST takes the same document as the "feedback" file of a multipart
+    // form, as sent by the upload form on the candidate page.
+    auto receive_feedback = [&tenants](const httplib::Request& req, httplib::Response& res,
+                                       const httplib::ContentReader& reader) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        std::string candidate_id = req.matches[1];
+        bool form = req.is_multipart_form_data();
+        CandidateDetail candidate;
+
+        if (!db.get_candidate(candidate_id, candidate)) {
+            res.status = 404;
+            res.set_content(api_error_json("candidate not found"), "application/json");
+            return;
+        }
+        if (candidate.closed) {
+            res.status = 409;
+            res.set_content(api_error_json("position is closed"), "application/json");
+            return;
+        }
+        if (!req.has_header("Content-Length")) {
+            res.status = 411;
+            res.set_content(api_error_json("Content-Length required"), "application/json");
+            return;
+        }
+        // A multipart body carries a little more than the document itself
+        size_t length = req.get_header_value_u64("Content-Length");
+        if (length > FeedbackUpload::max_size + (form ? 16 * 1024 : 0)) {
+            res.status = 413;
+            res.set_content(api_error_json("feedback too large"), "application/json");
+            return;
+        }
+
+        FeedbackUpload upload(db, candidate_id, length);
+        bool complete;
+        if (form) {
+            bool in_file = false;
+            complete = reader(
+                [&](const httplib::FormData& part) {
+                    in_file = part.name == "feedback";
+                    return true;
+                },
+                [&](const char* data, size_t len) { return !in_file || upload.feed(data, len); });
+        } else {
+            complete = reader([&](const char* data, size_t len) { return upload.feed(data, len); });
+        }
+
+        if (!complete || !upload.finish()) {
+            res.status = upload.too_large() ? 413 : 400;
+            res.set_content(api_error_json("feedback upload failed"), "application/json");
+            return;
+        }
+        if (form) {
+            res.set_redirect("/candidates/" + candidate_id, 303);
+            return;
+        }
+        res.set_content(feedback_upload_json(candidate_id, upload.size(), upload.stored()), "application/json");
+    };
+    svr.Put(R"(/candidates/([a-f0-9-]+)/feedback)", receive_feedback);
+    svr.Post(R"(/candidates/([a-f0-9-]+)/feedback)", receive_feedback);
+
+    // The whole document, read from the blob and inflated a piece at a time.
+    // Sent still compressed when the client accepts deflate. ?revision=N
+    // gives an earlier version, rebuilt from feedback_revisions.
+    svr.Get(R"(/candidates/([a-f0-9-]+)/feedback)", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        get_current_user(req, db);
+        if (req.has_param("revision")) {
+            std::string param = req.get_param_value("revision");
+            int revision = 0;
+            auto parsed = std::from_chars(param.data(), param.data() + param.size(), revision);
+            // Revisions are numbered from 1
+            if (parsed.ec != std::errc() || parsed.ptr != param.data() + param.size() || revision < 1) {
+                res.status = 400;
+                res.set_content("revision must be a positive integer", "text/plain");
+                return;
+            }
+            std::string text;
+            if (!db.get_feedback_revision(req.matches[1], revision, text)) {
+                res.status = 404;
+                res.set_content("No such revision", "text/plain");
+                return;
+            }
+            res.set_content(text, "text/plain; charset=utf-8");
+            return;
+        }
+        bool deflate = req.get_header_value("Accept-Encoding").find("deflate") != std::string::npos;
+        auto download = std::make_shared<FeedbackDownload>(
+            sqlite3_db_filename(db.db, "main"), db.has_archive ? sqlite3_db_filename(db.db, "archive") : "",
+            req.matches[1], deflate);
+        if (!download->found()) {
+            res.status = 404;
+            res.set_content("No feedback", "text/plain");
+            return;
+        }
+        if (deflate && download->compressed()) res.set_header("Content-Encoding", "deflate");
+        res.set_chunked_content_provider("text/plain; charset=utf-8",
+            [download](size_t, httplib::DataSink& sink) {
+                std::string out;
+                bool more = download->next_chunk(out);
+                if (!out.empty() && !sink.write(out.data(), out.size())) return false;
+                if (!more) sink.done();
+                return true;
+            });
+    });
+
     // Candidate detail
-    svr.Get(R"(/candidates/([a-f0-9-]+))", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Get(R"(/candidates/([a-f0-9-]+))", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
         User user = get_current_user(req, db);
         std::string candidate_id = req.matches[1];
         CandidateDetail candidate;
+        ScoreStats stats;
+        MyScore my_score;
 
-        if (!db.get_candidate(candidate_id, candidate)) {
+        if (!db.get_candidate_detail(candidate_id, user.id, candidate, stats, my_score)) {
             res.set_redirect("/");
             return;
         }
 
-        ScoreStats stats = db.get_score_stats(candidate_id);
-        MyScore my_score = db.get_my_score(candidate_id, user.id);
-
+        TRACE_SCOPE("render.candidate_detail_page");
         res.set_content(candidate_detail_page(user.name, "", candidate, stats, my_score), "text/html");
     });
 
     // Score/feedback submission
-    svr.Post(R"(/candidates/([a-f0-9-]+))", [&db](const httplib::Request& req, httplib::Response& res) {
+    svr.Post(R"(/candidates/([a-f0-9-]+))", [&tenants](const httplib::Request& req, httplib::Response& res) {
+        std::shared_ptr<Tenant> tenant = get_tenant(req, tenants);
+        Database& db = tenant->db;
+        RankingHub& hub = tenant->hub;
         User user = get_current_user(req, db);
         std::string candidate_id = req.matches[1];
         CandidateDetail candidate;
+        ScoreStats stats;
+        MyScore my_score;
 
-        if (!db.get_candidate(candidate_id, candidate)) {
+        if (!db.get_candidate_detail(candidate_id, user.id, candidate, stats, my_score)) {
             res.set_redirect("/");
             return;
         }
@@ -471,32 +858,41 @@ int main() {
         std::string action = params["action"];
         std::string flash;
 
-        if (action == "score") {
-            int hand_gestures = std::stoi(params["hand_gestures"]);
-            int stayed_awake = std::stoi(params["stayed_awake"]);
+        // The page is rendered from the snapshot above plus what the write
+        // returns; nothing is re-read afterwards.
+        if (candidate.closed) {
+            flash = "This position is closed.";
+        } else if (action == "score") {
+            int hand_gestures = std::atoi(params["hand_gestures"].c_str());
+            int stayed_awake = std::atoi(params["stayed_awake"].c_str());
 
-            if (hand_gestures >= 1 && hand_gestures <= 5 && stayed_awake >= 1 && stayed_awake <= 5) {
-                db.upsert_score(candidate_id, user.id, hand_gestures, stayed_awake);
+            if (hand_gestures < 1 || hand_gestures > 5 || stayed_awake < 1 || stayed_awake > 5) {
+                flash = "Scores must be between 1 and 5.";
+            } else if (db.upsert_score(candidate_id, user.id, hand_gestures, stayed_awake, stats)) {
+                my_score = {true, hand_gestures, stayed_awake};
+                hub.notify(candidate.position_id);
                 flash = "Score saved.";
             } else {
-                flash = "Scores must be between 1 and 5.";
+                // Closed (or deleted) since the snapshot
+                candidate.closed = true;
+                flash = "This position is closed.";
             }
         } else if (action == "feedback") {
             std::string feedback = params["student_feedback"];
             db.update_feedback(candidate_id, feedback);
+            candidate.student_feedback = feedback;
+            candidate.feedback_size = feedback.size();
             flash = "Feedback saved.";
         }
 
-        // Refresh data
-        db.get_candidate(candidate_id, candidate);
-        ScoreStats stats = db.get_score_stats(candidate_id);
-        MyScore my_score = db.get_my_score(candidate_id, user.id);
-
+        TRACE_SCOPE("render.candidate_detail_page");
         res.set_content(candidate_detail_page(user.name, flash, candidate, stats, my_score), "text/html");
     });
 
-    std::cout << "Server running at http://localhost:5000" << std::endl;
-    svr.listen("0.0.0.0", 5000);
+    std::cout << "Server running at http://localhost:" << port;
+    if (primary) std::cout << " (read-only follower of " << primary << ")";
+    std::cout << std::endl;
+    svr.listen("0.0.0.0", port);
 
     return 0;
 }
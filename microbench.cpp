@@ -0,0 +1,362 @@
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <regex>
+#include <string>
+#include <vector>
+#include "templates.h"
+#include "api.h"
+#include "form.h"
+#include "bench_util.h"
+
+// Microbenchmarks for the rendering and request-parsing path.
+//
+//   ./microbench                        # all benchmarks, table on stdout
+//   ./microbench --filter 'escape|form' --json micro.json
+//
+// Modelled on Google Benchmark: each benchmark is registered with one or more
+// argument sets, the iteration count is calibrated until a run takes at least
+// --min-time seconds, and heap allocations are counted through a replaced
+// global operator new.
+
+// ---- Allocation counting ----
+
+static std::atomic<uint64_t> g_alloc_count{0};
+static std::atomic<uint64_t> g_alloc_bytes{0};
+
+// Every replaced new has its matching deletes (plain, sized, aligned), all
+// ending in std::free, so no pointer reaches a library delete that did not
+// come from the matching library new. The deletes stay out of line: inlined,
+// GCC sees std::free applied to an operator new result and warns
+// (-Wmismatched-new-delete).
+
+#define NOINLINE __attribute__((noinline))
+
+void* operator new(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t a = static_cast<size_t>(align);
+    // aligned_alloc wants a non-zero multiple of the alignment
+    if (void* p = std::aligned_alloc(a, size ? (size + a - 1) / a * a : a)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, std::align_val_t align) { return operator new(size, align); }
+NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+NOINLINE void operator delete[](void* p) noexcept { std::free(p); }
+NOINLINE void operator delete(void* p, size_t) noexcept { std::free(p); }
+NOINLINE void operator delete[](void* p, size_t) noexcept { std::free(p); }
+NOINLINE void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+NOINLINE void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+NOINLINE void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+NOINLINE void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// ---- Harness ----
+
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State {
+public:
+    State(uint64_t iterations, std::vector<long> args) : iterations_(iterations), args_(std::move(args)) {}
+
+    long range(size_t i) const { return i < args_.size() ? args_[i] : 0; }
+    uint64_t iterations() const { return iterations_; }
+
+    // for ([[maybe_unused]] auto _ : state) { ... } runs the body iterations() times
+    struct Iterator {
+        uint64_t remaining;
+        bool operator!=(const Iterator&) const { return remaining != 0; }
+        void operator++() { remaining--; }
+        int operator*() const { return 0; }
+    };
+    Iterator begin() const { return {iterations_}; }
+    Iterator end() const { return {0}; }
+
+private:
+    uint64_t iterations_;
+    std::vector<long> args_;
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State&)> fn;
+    std::vector<std::vector<long>> arg_sets;
+
+    Benchmark& arg(long a) { arg_sets.push_back({a}); return *this; }
+    Benchmark& args(std::vector<long> a) { arg_sets.push_back(std::move(a)); return *this; }
+};
+
+// A deque, so the references register_benchmark hands out survive later
+// registrations
+std::deque<Benchmark>& registry() {
+    static std::deque<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+Benchmark& register_benchmark(const std::string& name, std::function<void(State&)> fn) {
+    registry().push_back({name, std::move(fn), {}});
+    return registry().back();
+}
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+};
+
+std::string full_name(const Benchmark& b, const std::vector<long>& args) {
+    std::string name = b.name;
+    for (long a : args) name += "/" + std::to_string(a);
+    return name;
+}
+
+Result run_one(const Benchmark& b, const std::vector<long>& args, double min_time) {
+    std::string name = full_name(b, args);
+    uint64_t iterations = 1;
+    while (true) {
+        State state(iterations, args);
+        uint64_t allocs_before = g_alloc_count.load();
+        uint64_t bytes_before = g_alloc_bytes.load();
+        auto start = std::chrono::steady_clock::now();
+        b.fn(state);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t allocs = g_alloc_count.load() - allocs_before;
+        uint64_t bytes = g_alloc_bytes.load() - bytes_before;
+
+        if (secs >= min_time || iterations >= (1ull << 30)) {
+            return {name, iterations, secs * 1e9 / iterations,
+                    double(allocs) / iterations, double(bytes) / iterations};
+        }
+        // Aim for 1.4x the minimum time, growing at most 10x per attempt
+        double scale = secs > 0 ? min_time * 1.4 / secs : 10;
+        iterations = static_cast<uint64_t>(iterations * std::min(std::max(scale, 2.0), 10.0));
+    }
+}
+
+#define BENCH_CONCAT_INNER(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_INNER(a, b)
+#define BENCHMARK(fn) static Benchmark& BENCH_CONCAT(bench_, __LINE__) = register_benchmark(#fn, fn)
+
+// ---- Inputs ----
+
+// Printable text with a sprinkling of characters that need HTML escaping
+std::string make_text(long length) {
+    static const char pattern[] = "Dr. O'Brien <chem> & \"physics\" lecturer; clear examples, good pace. ";
+    std::string s;
+    s.reserve(length);
+    for (long i = 0; i < length; i++) s += pattern[i % (sizeof(pattern) - 1)];
+    return s;
+}
+
+std::string form_encode(const std::string& s) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : s) {
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_') {
+            out += static_cast<char>(c);
+        } else if (c == ' ') {
+            out += '+';
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0xf];
+        }
+    }
+    return out;
+}
+
+const std::string uuid = "0f8fad5b-d9cb-469f-a165-70867728950e";
+
+// ---- Benchmarks ----
+
+void BM_html_escape(State& state) {
+    std::string input = make_text(state.range(0));
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(html_escape(input));
+}
+BENCHMARK(BM_html_escape).arg(16).arg(256).arg(4096).arg(65536);
+
+void BM_json_escape(State& state) {
+    std::string input = make_text(state.range(0));
+    std::string out;
+    for ([[maybe_unused]] auto _ : state) {
+        out.clear();
+        json_escape(out, input);
+        do_not_optimize(out);
+    }
+}
+BENCHMARK(BM_json_escape).arg(16).arg(256).arg(4096).arg(65536);
+
+void BM_url_decode(State& state) {
+    std::string input = form_encode(make_text(state.range(0)));
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(url_decode(input));
+}
+BENCHMARK(BM_url_decode).arg(16).arg(256).arg(4096).arg(65536);
+
+// Score submission form, then a feedback form of the given length
+void BM_parse_form_score(State& state) {
+    std::string body = "action=score&hand_gestures=4&stayed_awake=3";
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(parse_form(body));
+}
+BENCHMARK(BM_parse_form_score).arg(0);
+
+void BM_parse_form_feedback(State& state) {
+    std::string body = "action=feedback&student_feedback=" + form_encode(make_text(state.range(0)));
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(parse_form(body));
+}
+BENCHMARK(BM_parse_form_feedback).arg(256).arg(8192);
+
+void BM_score_option(State& state) {
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(score_option(3, 3, "Adequate"));
+}
+BENCHMARK(BM_score_option).arg(0);
+
+void BM_base_template(State& state) {
+    std::string content = make_text(state.range(0));
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(base_template("Positions", "Dev User", "Score saved.", content));
+}
+BENCHMARK(BM_base_template).arg(0).arg(4096).arg(65536);
+
+// args: number of positions, title length. Rows arrive as views, the way
+// Database::for_each_position hands them over.
+void BM_index_page(State& state) {
+    std::vector<Position> positions;
+    for (long i = 0; i < state.range(0); i++) {
+        positions.push_back({uuid, make_text(state.range(1)), "Interviewer " + std::to_string(i), int(i % 10)});
+    }
+    for ([[maybe_unused]] auto _ : state) {
+        do_not_optimize(index_page_rows("Dev User", "", "", [&](auto&& emit) {
+            for (const auto& p : positions) emit(PositionView{p.id, p.title, p.creator_name, p.candidate_count});
+            return std::string();
+        }));
+    }
+}
+BENCHMARK(BM_index_page).args({10, 32}).args({100, 32}).args({1000, 32}).args({100, 256});
+
+// args: number of positions, title length
+void BM_positions_json(State& state) {
+    std::vector<Position> positions;
+    for (long i = 0; i < state.range(0); i++) {
+        positions.push_back({uuid, make_text(state.range(1)), "Interviewer " + std::to_string(i), int(i % 10)});
+    }
+    for ([[maybe_unused]] auto _ : state) {
+        do_not_optimize(positions_json([&](auto&& emit) {
+            for (const auto& p : positions) emit(PositionView{p.id, p.title, p.creator_name, p.candidate_count});
+            return std::string();
+        }));
+    }
+}
+BENCHMARK(BM_positions_json).args({10, 32}).args({100, 32}).args({1000, 32}).args({100, 256});
+
+void BM_position_form_page(State& state) {
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(position_form_page("Dev User", ""));
+}
+BENCHMARK(BM_position_form_page).arg(0);
+
+// args: candidates per position, name length; rows as views, as in
+// BM_index_page
+void BM_position_detail_page(State& state) {
+    std::vector<CandidateRanking> candidates;
+    for (long i = 0; i < state.range(0); i++) {
+        candidates.push_back({uuid, make_text(state.range(1)), int(i % 6), 3.25, 4.5, 3.875});
+    }
+    for ([[maybe_unused]] auto _ : state) {
+        do_not_optimize(position_detail_page_rows("Dev User", "", uuid, "Lecturer - Chemistry", false, [&](auto&& emit) {
+            for (const auto& c : candidates) {
+                emit(CandidateRankingView{c.id, c.name, c.num_scores, c.avg_hand_gestures, c.avg_stayed_awake,
+                                          c.avg_total});
+            }
+        }));
+    }
+}
+BENCHMARK(BM_position_detail_page).args({5, 24}).args({10, 24}).args({100, 24}).args({1000, 24}).args({10, 256});
+
+void BM_candidate_form_page(State& state) {
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(candidate_form_page("Dev User", "", uuid, "Lecturer - Chemistry"));
+}
+BENCHMARK(BM_candidate_form_page).arg(0);
+
+// args: feedback length, name length
+void BM_candidate_detail_page(State& state) {
+    CandidateDetail candidate{uuid, make_text(state.range(1)), uuid, "Lecturer - Chemistry",
+                              make_text(state.range(0))};
+    ScoreStats stats{4, 3.25, 4.5, 3.875};
+    MyScore mine{true, 4, 3};
+    for ([[maybe_unused]] auto _ : state) do_not_optimize(candidate_detail_page("Dev User", "Score saved.", candidate, stats, mine));
+}
+BENCHMARK(BM_candidate_detail_page).args({0, 24}).args({1024, 24}).args({65536, 24}).args({1024, 256});
+
+// args: number of hits, snippet length. Hits carry the \x01/\x02 match
+// markers search_candidates puts around matched words.
+void BM_search_page(State& state) {
+    std::string name = "Ada \x01" "Chem\x02" "bers";
+    std::string title = "Lecturer - \x01" "Chem\x02" "istry";
+    std::string snippet = make_text(state.range(1) / 2) + "\x01" "chemistry\x02 " + make_text(state.range(1) / 2);
+    for ([[maybe_unused]] auto _ : state) {
+        do_not_optimize(search_page("Dev User", "chem", [&](auto&& emit) {
+            for (long i = 0; i < state.range(0); i++) emit(SearchHitView{uuid, uuid, title, name, snippet, -1.5});
+        }));
+    }
+}
+BENCHMARK(BM_search_page).args({0, 64}).args({20, 64}).args({20, 256});
+
+int main(int argc, char** argv) {
+    auto args = parse_args(argc, argv);
+    if (args.count("help")) {
+        std::cout << "usage: microbench [--filter REGEX] [--min-time SECONDS] [--json FILE]\n";
+        return 0;
+    }
+    std::regex filter(arg_or(args, "filter", "."));
+    double min_time = std::stod(arg_or(args, "min-time", "0.2"));
+
+    std::vector<Result> results;
+    std::printf("%-40s %14s %14s %12s %12s\n", "Benchmark", "Time (ns)", "Iterations", "Allocs/op", "Bytes/op");
+    for (const auto& b : registry()) {
+        for (const auto& set : b.arg_sets) {
+            if (!std::regex_search(full_name(b, set), filter)) continue;
+            run_one(b, set, min_time / 10);  // warm-up
+            Result r = run_one(b, set, min_time);
+            std::printf("%-40s %14.1f %14llu %12.1f %12.1f\n", r.name.c_str(), r.ns_per_op,
+                        static_cast<unsigned long long>(r.iterations), r.allocs_per_op, r.bytes_per_op);
+            results.push_back(r);
+        }
+    }
+
+    if (args.count("json")) {
+        std::string json = "{\"tool\":\"microbench\",\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            char buf[192];
+            snprintf(buf, sizeof(buf), "\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}",
+                     static_cast<unsigned long long>(r.iterations), r.ns_per_op, r.allocs_per_op, r.bytes_per_op);
+            if (i) json += ',';
+            json += "{\"name\":\"";
+            json_escape(json, r.name);
+            json += buf;
+        }
+        json += "]}";
+        if (!write_report(args["json"], json)) {
+            std::cerr << "microbench: cannot write " << args["json"] << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
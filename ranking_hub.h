@@ -0,0 +1,250 @@
+#ifndef RANKING_HUB_H
+#define RANKING_HUB_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "database.h"
+#include "json.h"
+
+// Fan-out hub for live ranking updates on /positions/:id/events.
+//
+// Writers call notify(position_id). A single background thread waits a short
+// coalescing window, recomputes each dirty position's ranking once, diffs it
+// against the previous ranking and publishes the changed rows as one event.
+// Every watcher of that position receives the same pre-serialised event, so
+// the cost per change is one query no matter how many browsers are open.
+// The thread starts with the first watcher.
+//
+// Events are JSON:
+//   {"v":7,"reset":false,"rows":[{"id":"..","name":"..","rank":1,"n":3,
+//    "hg":4.33,"sa":3.67,"avg":4.00}],"removed":["..."]}
+// A watcher that falls more than history events behind gets a reset event
+// carrying every row instead.
+//
+// Each watcher holds a server thread, so max_watchers caps them across
+// every hub that shares the watchers count (one per faculty, tenants.h).
+
+class RankingHub {
+public:
+    static constexpr auto coalesce_window = std::chrono::milliseconds(250);
+    static constexpr size_t history = 32;
+    static constexpr size_t max_watchers = 256;
+
+    // watchers is shared by every hub in the process; see max_watchers
+    RankingHub(Database& db, std::atomic<size_t>& watchers) : db_(db), watchers_(watchers) {}
+
+    ~RankingHub() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        events_cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    RankingHub(const RankingHub&) = delete;
+    RankingHub& operator=(const RankingHub&) = delete;
+
+    // Registers a watcher and returns the version it starts from through
+    // version. Returns false when max_watchers are open across all hubs.
+    bool subscribe(const std::string& position_id, uint64_t& version) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (watchers_.fetch_add(1) >= max_watchers) {
+            watchers_--;
+            return false;
+        }
+        if (!worker_.joinable()) worker_ = std::thread([this] { run(); });
+        Channel& ch = channels_[position_id];
+        ch.watchers++;
+        version = ch.version;
+        if (!ch.primed) mark_dirty(ch);
+        return true;
+    }
+
+    void unsubscribe(const std::string& position_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = channels_.find(position_id);
+        if (it == channels_.end()) return;
+        watchers_--;
+        if (--it->second.watchers == 0) channels_.erase(it);
+    }
+
+    // Call after any write that may change position_id's ranking
+    void notify(const std::string& position_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = channels_.find(position_id);
+        if (it != channels_.end()) mark_dirty(it->second);
+    }
+
+    // Waits up to timeout for events newer than seen, appends them to out as
+    // SSE frames and advances seen. Returns false if nothing arrived.
+    bool wait_events(const std::string& position_id, uint64_t& seen,
+                     std::chrono::milliseconds timeout, std::string& out) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        events_cv_.wait_until(lock, deadline, [&] {
+            auto it = channels_.find(position_id);
+            return stopping_ || (it != channels_.end() && it->second.version > seen);
+        });
+        auto it = channels_.find(position_id);
+        if (it == channels_.end() || it->second.version <= seen) return false;
+
+        const Channel& ch = it->second;
+        if (ch.events.empty() || ch.events.front().first > seen + 1) {
+            append_frame(out, ch.version, ch.snapshot);
+        } else {
+            for (const auto& event : ch.events) {
+                if (event.first > seen) append_frame(out, event.first, event.second);
+            }
+        }
+        seen = ch.version;
+        return true;
+    }
+
+private:
+    struct Row {
+        std::string name;
+        int rank;
+        int num_scores;
+        double avg_hand_gestures;
+        double avg_stayed_awake;
+        double avg_total;
+
+        bool operator==(const Row& o) const {
+            return rank == o.rank && num_scores == o.num_scores && name == o.name &&
+                   avg_hand_gestures == o.avg_hand_gestures && avg_stayed_awake == o.avg_stayed_awake &&
+                   avg_total == o.avg_total;
+        }
+    };
+
+    struct Channel {
+        int watchers = 0;
+        bool dirty = false;
+        bool primed = false;
+        std::chrono::steady_clock::time_point dirty_since;
+        uint64_t version = 0;
+        std::deque<std::pair<uint64_t, std::string>> events;
+        std::string snapshot;                 // reset event for lagging watchers
+        std::map<std::string, Row> rows;      // only touched by the worker thread
+    };
+
+    void mark_dirty(Channel& ch) {
+        if (ch.dirty) return;
+        ch.dirty = true;
+        ch.dirty_since = std::chrono::steady_clock::now();
+        work_cv_.notify_one();
+    }
+
+    static void append_frame(std::string& out, uint64_t version, const std::string& data) {
+        out += "id: " + std::to_string(version) + "\nevent: ranking\ndata: " + data + "\n\n";
+    }
+
+    static void append_row(std::string& out, const std::string& id, const Row& r) {
+        char numbers[160];
+        snprintf(numbers, sizeof(numbers), "\",\"rank\":%d,\"n\":%d,\"hg\":%.2f,\"sa\":%.2f,\"avg\":%.2f}",
+                 r.rank, r.num_scores, r.avg_hand_gestures, r.avg_stayed_awake, r.avg_total);
+        out += "{\"id\":\"";
+        json_escape(out, id);
+        out += "\",\"name\":\"";
+        json_escape(out, r.name);
+        out += numbers;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            // Sleep until the oldest dirty channel's window has elapsed
+            auto due = std::chrono::steady_clock::time_point::max();
+            for (const auto& entry : channels_) {
+                if (entry.second.dirty) due = std::min(due, entry.second.dirty_since + coalesce_window);
+            }
+            if (due == std::chrono::steady_clock::time_point::max()) {
+                work_cv_.wait(lock);
+                continue;
+            }
+            if (std::chrono::steady_clock::now() < due) {
+                work_cv_.wait_until(lock, due);
+                continue;
+            }
+
+            std::vector<std::string> dirty;
+            auto now = std::chrono::steady_clock::now();
+            for (auto& entry : channels_) {
+                if (entry.second.dirty && entry.second.dirty_since + coalesce_window <= now) {
+                    entry.second.dirty = false;
+                    dirty.push_back(entry.first);
+                }
+            }
+
+            for (const auto& position_id : dirty) {
+                // Query without holding the hub lock; writers and watchers keep going
+                lock.unlock();
+                std::map<std::string, Row> rows;
+                int rank = 0;
+                db_.for_each_candidate_ranking(position_id, [&](const CandidateRankingView& c) {
+                    rows[std::string(c.id)] = Row{std::string(c.name), ++rank, c.num_scores,
+                                                  c.avg_hand_gestures, c.avg_stayed_awake, c.avg_total};
+                });
+                lock.lock();
+
+                auto it = channels_.find(position_id);
+                if (it != channels_.end()) publish(it->second, std::move(rows));
+            }
+            events_cv_.notify_all();
+        }
+    }
+
+    void publish(Channel& ch, std::map<std::string, Row> rows) {
+        bool reset = !ch.primed;
+        std::string changed, removed;
+        for (const auto& entry : rows) {
+            auto old = ch.rows.find(entry.first);
+            if (reset || old == ch.rows.end() || !(old->second == entry.second)) {
+                if (!changed.empty()) changed += ',';
+                append_row(changed, entry.first, entry.second);
+            }
+        }
+        for (const auto& entry : ch.rows) {
+            if (rows.count(entry.first)) continue;
+            if (!removed.empty()) removed += ',';
+            removed += '"';
+            json_escape(removed, entry.first);
+            removed += '"';
+        }
+        ch.rows = std::move(rows);
+        ch.primed = true;
+        if (!reset && changed.empty() && removed.empty()) return;
+
+        ch.version++;
+        std::string all;
+        for (const auto& entry : ch.rows) {
+            if (!all.empty()) all += ',';
+            append_row(all, entry.first, entry.second);
+        }
+        std::string v = std::to_string(ch.version);
+        ch.snapshot = "{\"v\":" + v + ",\"reset\":true,\"rows\":[" + all + "],\"removed\":[]}";
+        ch.events.emplace_back(ch.version, reset ? ch.snapshot
+            : "{\"v\":" + v + ",\"reset\":false,\"rows\":[" + changed + "],\"removed\":[" + removed + "]}");
+        while (ch.events.size() > history) ch.events.pop_front();
+    }
+
+    Database& db_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable events_cv_;
+    std::map<std::string, Channel> channels_;
+    std::atomic<size_t>& watchers_;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif // RANKING_HUB_H
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "httplib.h"
+#include "bench_util.h"
+#include "capture.h"
+
+// Replays captured traffic (see capture.h; the server writes captures when
+// CANDIDATE_SCORING_CAPTURE is set) against a running server.
+//
+//   ./replay capture.jsonl --speed 1 --concurrency 16 --output replay.json --diffs diffs.jsonl
+//
+// Requests are issued at their original relative times divided by --speed
+// (--speed 0 sends as fast as the workers allow). Latency is measured from the
+// scheduled time, so falling behind the original pace shows up as latency;
+// service time is measured from the actual send. When the capture recorded a
+// response, status and body hash are compared and mismatches reported. Bodies
+// are compared with UUIDs masked when the capture has response_hash_ids, as
+// ids minted during the replay never match the captured ones; --exact-bodies
+// compares them byte for byte. Methods other than GET, HEAD, POST, PUT,
+// PATCH, DELETE and OPTIONS are not sent and count as errors.
+//
+// Captured paths contain the ids that existed at capture time, so replay
+// against a copy of the database taken when the capture started.
+
+struct Outcome {
+    bool sent = false;
+    int status = 0;
+    std::string hash;
+    std::string hash_ids;
+    long length = 0;
+    double latency_us = 0;
+    double service_us = 0;
+};
+
+// "/candidates/<uuid>?x=1" -> "/candidates/:id"
+std::string route_of(const CapturedRequest& r) {
+    static const std::regex uuid("[a-f0-9]{8}-[a-f0-9]{4}-[a-f0-9]{4}-[a-f0-9]{4}-[a-f0-9]{12}");
+    std::string path = r.path.substr(0, r.path.find('?'));
+    return r.method + " " + std::regex_replace(path, uuid, ":id");
+}
+
+int main(int argc, char** argv) {
+    auto args = parse_args(argc, argv);
+    std::string input = argc > 1 && argv[1][0] != '-' ? argv[1] : arg_or(args, "input", "");
+    if (args.count("help") || input.empty()) {
+        std::cout << "usage: replay CAPTURE.jsonl [--host H] [--port P] [--speed FACTOR] [--concurrency N]\n"
+                     "              [--limit N] [--output FILE] [--diffs FILE] [--exact-bodies]\n";
+        return input.empty() && !args.count("help") ? 1 : 0;
+    }
+
+    std::string host = arg_or(args, "host", "localhost");
+    int port = std::stoi(arg_or(args, "port", "5000"));
+    double speed = std::stod(arg_or(args, "speed", "1"));
+    int concurrency = std::max(1, std::stoi(arg_or(args, "concurrency", "8")));
+    size_t limit = std::stoul(arg_or(args, "limit", "0"));
+    std::string output = arg_or(args, "output", "-");
+    std::string diffs_path = arg_or(args, "diffs", "");
+    bool exact_bodies = args.count("exact-bodies") > 0;
+
+    std::ifstream in(input);
+    if (!in) {
+        std::cerr << "replay: cannot open " << input << std::endl;
+        return 1;
+    }
+    std::vector<CapturedRequest> requests;
+    size_t skipped = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        CapturedRequest r;
+        if (parse_capture(line, r)) {
+            requests.push_back(std::move(r));
+        } else {
+            skipped++;
+        }
+        if (limit && requests.size() >= limit) break;
+    }
+    std::stable_sort(requests.begin(), requests.end(),
+                     [](const CapturedRequest& a, const CapturedRequest& b) { return a.timestamp < b.timestamp; });
+    if (requests.empty()) {
+        std::cerr << "replay: no requests in " << input << std::endl;
+        return 1;
+    }
+    std::cerr << "replay: " << requests.size() << " requests (" << skipped << " unparseable lines skipped), "
+              << concurrency << " workers, speed " << speed << std::endl;
+
+    std::vector<Outcome> outcomes(requests.size());
+    std::atomic<size_t> next{0};
+    double first_ts = requests.front().timestamp;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < concurrency; w++) {
+        workers.emplace_back([&]() {
+            httplib::Client cli(host, port);
+            cli.set_keep_alive(true);
+            cli.set_tcp_nodelay(true);
+            for (size_t i = next++; i < requests.size(); i = next++) {
+                const CapturedRequest& r = requests[i];
+                auto due = start;
+                if (speed > 0) {
+                    due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>((r.timestamp - first_ts) / speed));
+                    std::this_thread::sleep_until(due);
+                }
+                auto sent = std::chrono::steady_clock::now();
+                if (speed <= 0) due = sent;
+
+                httplib::Headers headers(r.headers.begin(), r.headers.end());
+                std::string content_type = "application/x-www-form-urlencoded";
+                auto ct = headers.find("Content-Type");
+                if (ct != headers.end()) {
+                    content_type = ct->second;
+                    headers.erase(ct);
+                }
+
+                httplib::Result res =
+                    r.method == "GET" ? cli.Get(r.path, headers)
+                    : r.method == "HEAD" ? cli.Head(r.path, headers)
+                    : r.method == "POST" ? cli.Post(r.path, headers, r.body, content_type)
+                    : r.method == "PUT" ? cli.Put(r.path, headers, r.body, content_type)
+                    : r.method == "PATCH" ? cli.Patch(r.path, headers, r.body, content_type)
+                    : r.method == "DELETE" ? cli.Delete(r.path, headers, r.body, content_type)
+                    : r.method == "OPTIONS" ? cli.Options(r.path, headers)
+                    : httplib::Result(nullptr, httplib::Error::Unknown);
+
+                auto done = std::chrono::steady_clock::now();
+                Outcome& o = outcomes[i];
+                o.sent = static_cast<bool>(res);
+                o.latency_us = elapsed_us(due, done);
+                o.service_us = elapsed_us(sent, done);
+                if (res) {
+                    o.status = res->status;
+                    o.length = static_cast<long>(res->body.size());
+                    o.hash = body_hash(res->body);
+                    o.hash_ids = body_hash(mask_uuids(res->body));
+                }
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LatencyRecorder latency, service;
+    std::map<std::string, LatencyRecorder> by_route;
+    size_t errors = 0, compared = 0, status_mismatches = 0, body_mismatches = 0;
+    std::string diff_lines;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        const CapturedRequest& r = requests[i];
+        const Outcome& o = outcomes[i];
+        if (!o.sent) {
+            errors++;
+            continue;
+        }
+        latency.add(o.latency_us);
+        service.add(o.service_us);
+        by_route[route_of(r)].add(o.service_us);
+        if (o.status >= 500) errors++;
+
+        if (r.status == 0) continue;
+        compared++;
+        bool status_differs = o.status != r.status;
+        // The capture hashes the body the handler built; a HEAD reply carries none
+        bool body_differs = r.method != "HEAD" &&
+                            (!exact_bodies && !r.response_hash_ids.empty() ? o.hash_ids != r.response_hash_ids
+                             : !r.response_hash.empty() && o.hash != r.response_hash);
+        status_mismatches += status_differs;
+        body_mismatches += body_differs;
+        if (status_differs || body_differs) {
+            diff_lines += "{\"index\":" + std::to_string(i) + ",\"method\":\"";
+            json_escape(diff_lines, r.method);
+            diff_lines += "\",\"path\":\"";
+            json_escape(diff_lines, r.path);
+            diff_lines += "\",\"expected_status\":" + std::to_string(r.status) +
+                          ",\"actual_status\":" + std::to_string(o.status) +
+                          ",\"expected_length\":" + std::to_string(r.response_length) +
+                          ",\"actual_length\":" + std::to_string(o.length) + "}\n";
+        }
+    }
+
+    if (!diffs_path.empty()) {
+        std::ofstream out(diffs_path);
+        out << diff_lines;
+    }
+
+    char head[256];
+    snprintf(head, sizeof(head),
+             "{\"tool\":\"replay\",\"requests\":%zu,\"errors\":%zu,\"speed\":%g,\"concurrency\":%d,"
+             "\"duration_s\":%.3f,\"throughput_rps\":%.1f,",
+             requests.size(), errors, speed, concurrency, elapsed, requests.size() / elapsed);
+    std::string json = head;
+    json += "\"latency_us\":";
+    append_latency_json(json, latency.summarize());
+    json += ",\"service_us\":";
+    append_latency_json(json, service.summarize());
+    json += ",\"routes\":{";
+    bool first = true;
+    for (auto& route : by_route) {
+        if (!first) json += ',';
+        first = false;
+        json += '"';
+        json_escape(json, route.first);
+        json += "\":";
+        append_latency_json(json, route.second.summarize());
+    }
+    json += "},\"diffs\":{\"compared\":" + std::to_string(compared) +
+            ",\"status_mismatches\":" + std::to_string(status_mismatches) +
+            ",\"body_mismatches\":" + std::to_string(body_mismatches) + "}}";
+
+    if (!write_report(output, json)) {
+        std::cerr << "replay: cannot write " << output << std::endl;
+        return 1;
+    }
+    return errors == 0 ? 0 : 2;
+}
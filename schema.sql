@@ -2,6 +2,10 @@
 -- SQLite implementation
 
 PRAGMA foreign_keys = ON;
+-- Before any table exists, so freed pages can be released a few at a time
+PRAGMA auto_vacuum = INCREMENTAL;
+-- user_version is left at 0: the server treats the file as unversioned,
+-- finds every table in place and runs the migrations from there
 
 -- Users table (populated from SSO)
 CREATE TABLE IF NOT EXISTS users (
@@ -16,7 +20,10 @@ CREATE TABLE IF NOT EXISTS positions (
     id TEXT PRIMARY KEY,
     title TEXT NOT NULL,
     created_by TEXT NOT NULL REFERENCES users(id),
-    created_at TEXT NOT NULL DEFAULT (datetime('now'))
+    created_at TEXT NOT NULL DEFAULT (datetime('now')),
+    candidate_count INTEGER NOT NULL DEFAULT 0,  -- maintained by triggers below
+    closed_at TEXT,      -- no new candidates, scores or feedback
+    archived_at TEXT     -- rows moved to the archive database (archive.h)
 );
 
 -- Candidates
@@ -24,10 +31,33 @@ CREATE TABLE IF NOT EXISTS candidates (
     id TEXT PRIMARY KEY,
     position_id TEXT NOT NULL REFERENCES positions(id) ON DELETE CASCADE,
     name TEXT NOT NULL,
-    student_feedback TEXT,
     created_at TEXT NOT NULL DEFAULT (datetime('now'))
 );
 
+-- Student feedback, kept out of candidates so ranking scans read small rows.
+-- body is zlib-compressed when codec = 1 and stored as-is when codec = 0;
+-- size is the uncompressed length in bytes.
+CREATE TABLE IF NOT EXISTS candidate_feedback (
+    candidate_id TEXT PRIMARY KEY REFERENCES candidates(id) ON DELETE CASCADE,
+    codec INTEGER NOT NULL,
+    size INTEGER NOT NULL,
+    body BLOB NOT NULL
+);
+
+-- Every saved version of a candidate's feedback: a full snapshot every 16
+-- revisions, otherwise a binary delta against the revision before
+CREATE TABLE IF NOT EXISTS feedback_revisions (
+    candidate_id TEXT NOT NULL REFERENCES candidates(id) ON DELETE CASCADE,
+    revision INTEGER NOT NULL,
+    is_delta INTEGER NOT NULL,
+    codec INTEGER NOT NULL,
+    size INTEGER NOT NULL,
+    text_size INTEGER NOT NULL,
+    body BLOB NOT NULL,
+    created_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (candidate_id, revision)
+);
+
 -- Scores (one per interviewer per candidate)
 CREATE TABLE IF NOT EXISTS scores (
     id TEXT PRIMARY KEY,
@@ -40,24 +70,131 @@ CREATE TABLE IF NOT EXISTS scores (
     UNIQUE (candidate_id, interviewer_id)
 );
 
+-- Change log for /api/changes (one row per entity, latest version wins)
+CREATE TABLE IF NOT EXISTS change_log (
+    version INTEGER PRIMARY KEY AUTOINCREMENT,
+    entity TEXT NOT NULL,
+    entity_id TEXT NOT NULL,
+    op TEXT NOT NULL CHECK (op IN ('upsert', 'delete')),
+    UNIQUE (entity, entity_id)
+);
+
+-- How far a follower has applied each primary's change log
+CREATE TABLE IF NOT EXISTS replication_state (
+    source TEXT PRIMARY KEY,
+    version INTEGER NOT NULL
+);
+
+-- Streamed feedback uploads in progress, copied into candidate_feedback
+-- once complete
+CREATE TABLE IF NOT EXISTS feedback_uploads (
+    id INTEGER PRIMARY KEY,
+    candidate_id TEXT NOT NULL REFERENCES candidates(id) ON DELETE CASCADE,
+    body BLOB NOT NULL
+);
+
+-- Full-text search over candidates (rowid = candidates.rowid), maintained
+-- by the application's write paths
+CREATE VIRTUAL TABLE IF NOT EXISTS candidate_search USING fts5(
+    name, position_title, student_feedback,
+    tokenize = 'unicode61 remove_diacritics 2',
+    prefix = '2 3'
+);
+
 -- Indexes for common queries
 CREATE INDEX IF NOT EXISTS idx_candidates_position ON candidates(position_id);
 CREATE INDEX IF NOT EXISTS idx_scores_candidate ON scores(candidate_id);
 CREATE INDEX IF NOT EXISTS idx_scores_interviewer ON scores(interviewer_id);
 CREATE INDEX IF NOT EXISTS idx_positions_created_by ON positions(created_by);
+CREATE INDEX IF NOT EXISTS idx_positions_created_at ON positions(created_at DESC, id DESC);
+CREATE INDEX IF NOT EXISTS idx_positions_closed ON positions(closed_at) WHERE closed_at IS NOT NULL;
+
+-- Keep positions.candidate_count in step with the candidates table
+CREATE TRIGGER IF NOT EXISTS trg_candidates_count_insert AFTER INSERT ON candidates BEGIN
+    UPDATE positions SET candidate_count = candidate_count + 1 WHERE id = NEW.position_id;
+END;
+-- (except while archive_step empties an archived position)
+CREATE TRIGGER IF NOT EXISTS trg_candidates_count_delete AFTER DELETE ON candidates
+WHEN NOT EXISTS (SELECT 1 FROM positions WHERE id = OLD.position_id AND archived_at IS NOT NULL) BEGIN
+    UPDATE positions SET candidate_count = candidate_count - 1 WHERE id = OLD.position_id;
+END;
+CREATE TRIGGER IF NOT EXISTS trg_candidates_count_move AFTER UPDATE OF position_id ON candidates BEGIN
+    UPDATE positions SET candidate_count = candidate_count - 1 WHERE id = OLD.position_id;
+    UPDATE positions SET candidate_count = candidate_count + 1 WHERE id = NEW.position_id;
+END;
+
+-- Record every write to users, positions, candidates and scores in change_log,
+-- apart from archive_step's deletes
+CREATE TRIGGER IF NOT EXISTS trg_users_log_insert AFTER INSERT ON users BEGIN
+    DELETE FROM change_log WHERE entity = 'user' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('user', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_users_log_update AFTER UPDATE ON users BEGIN
+    DELETE FROM change_log WHERE entity = 'user' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('user', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_positions_log_insert AFTER INSERT ON positions BEGIN
+    DELETE FROM change_log WHERE entity = 'position' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('position', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_positions_log_update AFTER UPDATE ON positions BEGIN
+    DELETE FROM change_log WHERE entity = 'position' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('position', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_positions_log_delete AFTER DELETE ON positions
+WHEN OLD.archived_at IS NULL BEGIN
+    DELETE FROM change_log WHERE entity = 'position' AND entity_id = OLD.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('position', OLD.id, 'delete');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_candidates_log_insert AFTER INSERT ON candidates BEGIN
+    DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_candidates_log_update AFTER UPDATE ON candidates BEGIN
+    DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_candidates_log_delete AFTER DELETE ON candidates
+WHEN NOT EXISTS (SELECT 1 FROM positions WHERE id = OLD.position_id AND archived_at IS NOT NULL) BEGIN
+    DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = OLD.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', OLD.id, 'delete');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_feedback_log_insert AFTER INSERT ON candidate_feedback BEGIN
+    DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.candidate_id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.candidate_id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_feedback_log_update AFTER UPDATE ON candidate_feedback BEGIN
+    DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = NEW.candidate_id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', NEW.candidate_id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_feedback_log_delete AFTER DELETE ON candidate_feedback
+WHEN EXISTS (SELECT 1 FROM candidates WHERE id = OLD.candidate_id) BEGIN
+    DELETE FROM change_log WHERE entity = 'candidate' AND entity_id = OLD.candidate_id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('candidate', OLD.candidate_id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_scores_log_insert AFTER INSERT ON scores BEGIN
+    DELETE FROM change_log WHERE entity = 'score' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('score', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_scores_log_update AFTER UPDATE ON scores BEGIN
+    DELETE FROM change_log WHERE entity = 'score' AND entity_id = NEW.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('score', NEW.id, 'upsert');
+END;
+CREATE TRIGGER IF NOT EXISTS trg_scores_log_delete AFTER DELETE ON scores
+WHEN NOT EXISTS (
+    SELECT 1 FROM candidates c JOIN positions p ON p.id = c.position_id
+    WHERE c.id = OLD.candidate_id AND p.archived_at IS NOT NULL
+) BEGIN
+    DELETE FROM change_log WHERE entity = 'score' AND entity_id = OLD.id;
+    INSERT INTO change_log (entity, entity_id, op) VALUES ('score', OLD.id, 'delete');
+END;
+
+-- Data migrations still to run after an upgrade; after is how far each got
+CREATE TABLE IF NOT EXISTS schema_backfills (
+    name TEXT PRIMARY KEY,
+    after INTEGER NOT NULL DEFAULT 0
+);
 
--- View: Candidate rankings with averaged scores
-CREATE VIEW IF NOT EXISTS candidate_rankings AS
-SELECT
-    c.id AS candidate_id,
-    c.name AS candidate_name,
-    c.position_id,
-    p.title AS position_title,
-    COUNT(s.id) AS num_scores,
-    ROUND(AVG(s.hand_gestures), 2) AS avg_hand_gestures,
-    ROUND(AVG(s.stayed_awake), 2) AS avg_stayed_awake,
-    ROUND((AVG(s.hand_gestures) + AVG(s.stayed_awake)) / 2, 2) AS avg_total
-FROM candidates c
-JOIN positions p ON c.position_id = p.id
-LEFT JOIN scores s ON c.id = s.candidate_id
-GROUP BY c.id, c.name, c.position_id, p.title;
+-- The candidate_rankings view (averaged scores per candidate, open positions
+-- only) is defined once, in Database::migrations (database.h), and created
+-- when the server first opens the file.
@@ -0,0 +1,134 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Query and highlighting helpers for candidate search (see
+// Database::search_candidates). Words are split the way the FTS5 unicode61
+// tokenizer splits ASCII text: runs of letters and digits, with any non-ASCII
+// byte treated as part of a word.
+//
+// Highlighting is done here rather than with FTS5's highlight()/snippet():
+// those need a MATCH cursor positioned on each row, and for a prefix term
+// FTS5 rebuilds the term's whole merged doclist on every lookup.
+//
+// Matches are wrapped in \x01 ... \x02, which highlighted() in templates.h
+// turns into <mark> after escaping. Accented letters are compared as-is, so a
+// row found through remove_diacritics ("cafe" for "Café") is returned but not
+// marked.
+
+inline bool search_word_byte(unsigned char c) {
+    return std::isalnum(c) || c >= 0x80;
+}
+
+// Lower-cased words of text, in order
+inline std::vector<std::string> search_words(std::string_view text) {
+    std::vector<std::string> words;
+    std::string word;
+    for (size_t i = 0; i <= text.size(); i++) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (search_word_byte(c)) {
+            word += static_cast<char>(std::tolower(c));
+        } else if (!word.empty()) {
+            words.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    return words;
+}
+
+// FTS5 query requiring every word, the last one as a prefix so partial words
+// find results while typing. Quoting each word keeps FTS5 operators in user
+// input from being interpreted.
+inline std::string search_query(const std::vector<std::string>& words) {
+    std::string query;
+    for (size_t i = 0; i < words.size(); i++) {
+        if (i) query += ' ';
+        query += '"' + words[i] + '"';
+        if (i + 1 == words.size()) query += '*';
+    }
+    return query;
+}
+
+// Same rule as search_query: whole words, the last as a prefix
+inline bool search_word_matches(std::string_view token, const std::vector<std::string>& words) {
+    for (size_t i = 0; i < words.size(); i++) {
+        const std::string& w = words[i];
+        bool prefix = i + 1 == words.size();
+        if (token.size() < w.size() || (!prefix && token.size() != w.size())) continue;
+        size_t j = 0;
+        while (j < w.size() && std::tolower(static_cast<unsigned char>(token[j])) == static_cast<unsigned char>(w[j])) j++;
+        if (j == w.size()) return true;
+    }
+    return false;
+}
+
+// Byte ranges of the words in text
+inline std::vector<std::pair<size_t, size_t>> search_tokens(std::string_view text) {
+    std::vector<std::pair<size_t, size_t>> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!search_word_byte(static_cast<unsigned char>(text[i]))) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < text.size() && search_word_byte(static_cast<unsigned char>(text[i]))) i++;
+        tokens.emplace_back(start, i);
+    }
+    return tokens;
+}
+
+// Appends text[from, to) to out with matching words marked
+inline void mark_matches(std::string& out, std::string_view text, const std::vector<std::string>& words,
+                         const std::vector<std::pair<size_t, size_t>>& tokens, size_t from, size_t to) {
+    size_t run = from;
+    for (const auto& t : tokens) {
+        if (t.first < from || t.second > to) continue;
+        if (!search_word_matches(text.substr(t.first, t.second - t.first), words)) continue;
+        out.append(text.data() + run, t.first - run);
+        out += '\x01';
+        out.append(text.data() + t.first, t.second - t.first);
+        out += '\x02';
+        run = t.second;
+    }
+    out.append(text.data() + run, to - run);
+}
+
+inline std::string mark_matches(std::string_view text, const std::vector<std::string>& words) {
+    std::string out;
+    mark_matches(out, text, words, search_tokens(text), 0, text.size());
+    return out;
+}
+
+// Up to max_words words of text around the first match, with matches marked
+// and "..." where the text was cut. Empty if nothing in text matches.
+inline std::string match_snippet(std::string_view text, const std::vector<std::string>& words,
+                                 size_t max_words) {
+    auto tokens = search_tokens(text);
+    size_t first = 0;
+    while (first < tokens.size() &&
+           !search_word_matches(text.substr(tokens[first].first, tokens[first].second - tokens[first].first), words)) {
+        first++;
+    }
+    if (first == tokens.size()) return std::string();
+
+    // A little context before the match, the rest after it
+    size_t begin = first > max_words / 4 ? first - max_words / 4 : 0;
+    size_t end = std::min(tokens.size(), begin + max_words);
+    size_t from = begin == 0 ? 0 : tokens[begin].first;
+    size_t to = end == tokens.size() ? text.size() : tokens[end - 1].second;
+
+    std::string out;
+    if (from > 0) out += "...";
+    mark_matches(out, text, words, tokens, from, to);
+    if (to < text.size()) out += "...";
+    return out;
+}
+
+#endif // SEARCH_H
@@ -2,25 +2,82 @@
 #define TEMPLATES_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
+#include <iomanip>
+
+inline const char* html_entity(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        case '\'': return "&#39;";
+        default: return nullptr;
+    }
+}
 
 // Simple HTML escaping
-inline std::string html_escape(const std::string& s) {
+inline std::string html_escape(std::string_view s) {
     std::string result;
-    for (char c : s) {
-        switch (c) {
-            case '&': result += "&amp;"; break;
-            case '<': result += "&lt;"; break;
-            case '>': result += "&gt;"; break;
-            case '"': result += "&quot;"; break;
-            case '\'': result += "&#39;"; break;
-            default: result += c;
+    result.reserve(s.size() + s.size() / 8);
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (const char* entity = html_entity(s[i])) {
+            result.append(s.data() + run, i - run);
+            result += entity;
+            run = i + 1;
         }
     }
+    result.append(s.data() + run, s.size() - run);
     return result;
 }
 
+// Escape straight into a stream, writing unescaped runs in one call
+inline void html_escape_to(std::ostream& out, std::string_view s) {
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (const char* entity = html_entity(s[i])) {
+            out.write(s.data() + run, i - run);
+            out << entity;
+            run = i + 1;
+        }
+    }
+    out.write(s.data() + run, s.size() - run);
+}
+
+// Stream manipulator form: content << escaped(name)
+struct Escaped {
+    std::string_view text;
+};
+
+inline Escaped escaped(std::string_view s) { return {s}; }
+
+inline std::ostream& operator<<(std::ostream& out, Escaped e) {
+    html_escape_to(out, e.text);
+    return out;
+}
+
+// Stream manipulator for FTS5 highlight()/snippet() output: escapes the text
+// and turns the \x01 ... \x02 match markers into <mark> ... </mark>
+struct Highlighted {
+    std::string_view text;
+};
+
+inline Highlighted highlighted(std::string_view s) { return {s}; }
+
+inline std::ostream& operator<<(std::ostream& out, Highlighted h) {
+    size_t run = 0;
+    for (size_t i = 0; i <= h.text.size(); i++) {
+        if (i < h.text.size() && h.text[i] != '\x01' && h.text[i] != '\x02') continue;
+        html_escape_to(out, h.text.substr(run, i - run));
+        if (i < h.text.size()) out << (h.text[i] == '\x01' ? "<mark>" : "</mark>");
+        run = i + 1;
+    }
+    return out;
+}
+
 inline std::string base_template(const std::string& title, const std::string& user_name,
                                   const std::string& flash, const std::string& content) {
     std::ostringstream html;
@@ -29,7 +86,7 @@ inline std::string base_template(const std::string& title, const std::string& us
 <head>
     <meta charset="UTF-8">
     <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>)" << html_escape(title) << R"( - Candidate Scoring</title>
+    <title>)" << escaped(title) << R"( - Candidate Scoring</title>
     <style>
         * { box-sizing: border-box; }
         body {
@@ -106,17 +163,30 @@ inline std::string base_template(const std::string& title, const std::string& us
         .breadcrumb a { color: #666; }
         .header-row { display: flex; justify-content: space-between; align-items: center; margin-bottom: 1rem; }
         .header-row h2 { margin: 0; }
+        .search { flex: 1; margin: 0 1rem; }
+        .search input[type="search"] {
+            width: 100%;
+            padding: 0.25rem 0.5rem;
+            border: 1px solid #ccc;
+            border-radius: 4px;
+            font-size: 0.875rem;
+        }
+        mark { background: #fff3a0; padding: 0 1px; }
+        .snippet { font-size: 0.875rem; color: #444; margin-top: 0.25rem; }
     </style>
 </head>
 <body>
     <header>
         <a href="/"><h1>Candidate Scoring</h1></a>
-        <span class="user-info">)" << html_escape(user_name) << R"(</span>
+        <form class="search" method="GET" action="/search">
+            <input type="search" name="q" placeholder="Search candidates and feedback" aria-label="Search">
+        </form>
+        <span class="user-info">)" << escaped(user_name) << R"(</span>
     </header>
 )";
 
     if (!flash.empty()) {
-        html << "    <div class=\"flash\">" << html_escape(flash) << "</div>\n";
+        html << "    <div class=\"flash\">" << escaped(flash) << "</div>\n";
     }
 
     html << content;
@@ -133,8 +203,31 @@ struct Position {
     int candidate_count;
 };
 
-inline std::string index_page(const std::string& user_name, const std::string& flash,
-                               const std::vector<Position>& positions) {
+// Borrowed view of a position row; the strings may point straight into a
+// SQLite column and are only valid for the duration of the callback.
+struct PositionView {
+    std::string_view id;
+    std::string_view title;
+    std::string_view creator_name;
+    int candidate_count;
+};
+
+inline void index_page_card(std::ostream& content, const PositionView& p) {
+    content << "<div class=\"card\">\n";
+    content << "    <h2><a href=\"/positions/" << escaped(p.id) << "\">"
+            << escaped(p.title) << "</a></h2>\n";
+    content << "    <div class=\"card-meta\">" << p.candidate_count
+            << " candidate" << (p.candidate_count != 1 ? "s" : "")
+            << " &middot; Created by " << escaped(p.creator_name) << "</div>\n";
+    content << "</div>\n";
+}
+
+// for_each_position(emit) must call emit(const PositionView&) once per row
+// and return the cursor for the next page ("" when there is none). after is
+// the cursor this page started from.
+template <typename ForEachPosition>
+inline std::string index_page_rows(const std::string& user_name, const std::string& flash,
+                                   const std::string& after, ForEachPosition&& for_each_position) {
     std::ostringstream content;
     content << R"(
 <div class="header-row">
@@ -143,18 +236,22 @@ inline std::string index_page(const std::string& user_name, const std::string& f
 </div>
 )";
 
-    if (positions.empty()) {
+    size_t count = 0;
+    std::string next = for_each_position([&](const PositionView& p) {
+        index_page_card(content, p);
+        count++;
+    });
+    if (count == 0 && after.empty()) {
         content << "<p>No positions yet. <a href=\"/positions/new\">Create one</a> to get started.</p>";
-    } else {
-        for (const auto& p : positions) {
-            content << "<div class=\"card\">\n";
-            content << "    <h2><a href=\"/positions/" << html_escape(p.id) << "\">"
-                    << html_escape(p.title) << "</a></h2>\n";
-            content << "    <div class=\"card-meta\">" << p.candidate_count
-                    << " candidate" << (p.candidate_count != 1 ? "s" : "")
-                    << " &middot; Created by " << html_escape(p.creator_name) << "</div>\n";
-            content << "</div>\n";
+    }
+
+    if (!after.empty() || !next.empty()) {
+        content << "<div class=\"header-row\">\n";
+        content << "    " << (after.empty() ? "<span></span>" : "<a href=\"/\">&laquo; Newest</a>") << "\n";
+        if (!next.empty()) {
+            content << "    <a href=\"/?after=" << escaped(next) << "\">Older &raquo;</a>\n";
         }
+        content << "</div>\n";
     }
 
     return base_template("Positions", user_name, flash, content.str());
@@ -188,26 +285,66 @@ struct CandidateRanking {
     double avg_total;
 };
 
-inline std::string position_detail_page(const std::string& user_name, const std::string& flash,
-                                         const std::string& position_id, const std::string& position_title,
-                                         const std::vector<CandidateRanking>& candidates) {
+// Borrowed view of a ranking row, valid for the duration of the callback
+struct CandidateRankingView {
+    std::string_view id;
+    std::string_view name;
+    int num_scores;
+    double avg_hand_gestures;
+    double avg_stayed_awake;
+    double avg_total;
+};
+
+inline void position_detail_row(std::ostream& content, const CandidateRankingView& c, int rank) {
+    content << "            <tr data-id=\"" << escaped(c.id) << "\">\n";
+    content << "                <td>" << rank << "</td>\n";
+    content << "                <td><a href=\"/candidates/" << escaped(c.id) << "\">"
+            << escaped(c.name) << "</a></td>\n";
+    if (c.num_scores > 0) {
+        content << "                <td>" << std::fixed << std::setprecision(2) << c.avg_hand_gestures << "</td>\n";
+        content << "                <td>" << std::fixed << std::setprecision(2) << c.avg_stayed_awake << "</td>\n";
+        content << "                <td><strong>" << std::fixed << std::setprecision(2) << c.avg_total << "</strong></td>\n";
+    } else {
+        content << "                <td>-</td>\n";
+        content << "                <td>-</td>\n";
+        content << "                <td><strong>-</strong></td>\n";
+    }
+    content << "                <td>" << c.num_scores << "</td>\n";
+    content << "            </tr>\n";
+}
+
+// for_each_candidate(emit) must call emit(const CandidateRankingView&) once
+// per row, in rank order. A closed position offers no more changes.
+template <typename ForEachCandidate>
+inline std::string position_detail_page_rows(const std::string& user_name, const std::string& flash,
+                                             const std::string& position_id, const std::string& position_title,
+                                             bool closed, ForEachCandidate&& for_each_candidate) {
     std::ostringstream content;
     content << R"(
 <div class="breadcrumb">
-    <a href="/">Positions</a> &raquo; )" << html_escape(position_title) << R"(
+    <a href="/">Positions</a> &raquo; )" << escaped(position_title) << R"(
 </div>
 
 <div class="header-row">
-    <h2>)" << html_escape(position_title) << R"(</h2>
-    <a href="/positions/)" << html_escape(position_id) << R"(/candidates/new" class="btn">Add Candidate</a>
-</div>
+    <h2>)" << escaped(position_title) << R"(</h2>
 )";
-
-    if (candidates.empty()) {
-        content << "<p>No candidates yet. <a href=\"/positions/" << html_escape(position_id)
-                << "/candidates/new\">Add one</a> to get started.</p>";
+    if (closed) {
+        content << "    <span>Closed</span>\n";
     } else {
-        content << R"(<div class="card">
+        content << R"(    <div>
+        <a href="/positions/)" << escaped(position_id) << R"(/candidates/new" class="btn">Add Candidate</a>
+        <form method="POST" action="/positions/)" << escaped(position_id) << R"(/close" style="display: inline;">
+            <button type="submit">Close Position</button>
+        </form>
+    </div>
+)";
+    }
+    content << "</div>\n";
+
+    int rank = 0;
+    for_each_candidate([&](const CandidateRankingView& c) {
+        if (rank == 0) {
+            content << R"(<div class="card">
     <table>
         <thead>
             <tr>
@@ -219,32 +356,66 @@ inline std::string position_detail_page(const std::string& user_name, const std:
                 <th>Scores</th>
             </tr>
         </thead>
-        <tbody>
+        <tbody id="rankings">
 )";
-        int rank = 1;
-        for (const auto& c : candidates) {
-            content << "            <tr>\n";
-            content << "                <td>" << rank++ << "</td>\n";
-            content << "                <td><a href=\"/candidates/" << html_escape(c.id) << "\">"
-                    << html_escape(c.name) << "</a></td>\n";
-            if (c.num_scores > 0) {
-                content << "                <td>" << std::fixed << std::setprecision(2) << c.avg_hand_gestures << "</td>\n";
-                content << "                <td>" << std::fixed << std::setprecision(2) << c.avg_stayed_awake << "</td>\n";
-                content << "                <td><strong>" << std::fixed << std::setprecision(2) << c.avg_total << "</strong></td>\n";
-            } else {
-                content << "                <td>-</td>\n";
-                content << "                <td>-</td>\n";
-                content << "                <td><strong>-</strong></td>\n";
-            }
-            content << "                <td>" << c.num_scores << "</td>\n";
-            content << "            </tr>\n";
         }
+        position_detail_row(content, c, ++rank);
+    });
+
+    if (rank == 0 && closed) {
+        content << "<p>No candidates.</p>";
+    } else if (rank == 0) {
+        content << "<p>No candidates yet. <a href=\"/positions/" << escaped(position_id)
+                << "/candidates/new\">Add one</a> to get started.</p>";
+    } else {
         content << R"(        </tbody>
     </table>
 </div>
 )";
     }
 
+    // Apply ranking deltas from /positions/:id/events (see ranking_hub.h)
+    content << R"(<script>
+(function() {
+    var body = document.getElementById('rankings');
+    var source = new EventSource('/positions/)" << escaped(position_id) << R"(/events');
+    source.addEventListener('ranking', function(e) {
+        var delta = JSON.parse(e.data);
+        if (!body) {
+            if (delta.rows.length) location.reload();
+            return;
+        }
+        var rows = {};
+        Array.prototype.forEach.call(body.rows, function(tr) { rows[tr.dataset.id] = tr; });
+        if (delta.reset) {
+            Object.keys(rows).forEach(function(id) { delta.removed.push(id); });
+        }
+        delta.removed.forEach(function(id) {
+            if (rows[id]) body.removeChild(rows[id]);
+            delete rows[id];
+        });
+        delta.rows.forEach(function(r) {
+            var tr = rows[r.id] || document.createElement('tr');
+            var fmt = function(x) { return r.n > 0 ? x.toFixed(2) : '-'; };
+            tr.dataset.id = r.id;
+            tr.innerHTML = '<td></td><td><a></a></td><td></td><td></td><td><strong></strong></td><td></td>';
+            tr.cells[0].textContent = r.rank;
+            tr.cells[1].firstChild.href = '/candidates/' + r.id;
+            tr.cells[1].firstChild.textContent = r.name;
+            tr.cells[2].textContent = fmt(r.hg);
+            tr.cells[3].textContent = fmt(r.sa);
+            tr.cells[4].firstChild.textContent = fmt(r.avg);
+            tr.cells[5].textContent = r.n;
+            rows[r.id] = tr;
+        });
+        Object.keys(rows).map(function(id) { return rows[id]; })
+            .sort(function(a, b) { return a.cells[0].textContent - b.cells[0].textContent; })
+            .forEach(function(tr) { body.appendChild(tr); });
+    });
+})();
+</script>
+)";
+
     return base_template(position_title, user_name, flash, content.str());
 }
 
@@ -254,7 +425,7 @@ inline std::string candidate_form_page(const std::string& user_name, const std::
     content << R"(
 <div class="breadcrumb">
     <a href="/">Positions</a> &raquo;
-    <a href="/positions/)" << html_escape(position_id) << "\">" << html_escape(position_title) << R"(</a> &raquo;
+    <a href="/positions/)" << escaped(position_id) << "\">" << escaped(position_title) << R"(</a> &raquo;
     Add Candidate
 </div>
 
@@ -264,7 +435,7 @@ inline std::string candidate_form_page(const std::string& user_name, const std::
         <label for="name">Candidate Name</label>
         <input type="text" id="name" name="name" placeholder="e.g., Dr. Jane Smith" required>
         <button type="submit">Add Candidate</button>
-        <a href="/positions/)" << html_escape(position_id) << R"(" class="btn btn-secondary">Cancel</a>
+        <a href="/positions/)" << escaped(position_id) << R"(" class="btn btn-secondary">Cancel</a>
     </form>
 </div>
 )";
@@ -276,7 +447,9 @@ struct CandidateDetail {
     std::string name;
     std::string position_id;
     std::string position_title;
-    std::string student_feedback;
+    std::string student_feedback;   // empty when longer than Database::feedback_inline_max
+    size_t feedback_size = 0;       // bytes
+    bool closed = false;            // position closed (or archived): read-only
 };
 
 struct ScoreStats {
@@ -307,12 +480,12 @@ inline std::string candidate_detail_page(const std::string& user_name, const std
     content << R"(
 <div class="breadcrumb">
     <a href="/">Positions</a> &raquo;
-    <a href="/positions/)" << html_escape(candidate.position_id) << "\">"
-            << html_escape(candidate.position_title) << R"(</a> &raquo;
-    )" << html_escape(candidate.name) << R"(
+    <a href="/positions/)" << escaped(candidate.position_id) << "\">"
+            << escaped(candidate.position_title) << R"(</a> &raquo;
+    )" << escaped(candidate.name) << R"(
 </div>
 
-<h2>)" << html_escape(candidate.name) << R"(</h2>
+<h2>)" << escaped(candidate.name) << R"(</h2>
 
 <!-- Score Summary -->
 <div class="card">
@@ -343,8 +516,27 @@ inline std::string candidate_detail_page(const std::string& user_name, const std
         content << "    <p>No scores yet. Be the first to score this candidate.</p>\n";
     }
 
-    content << R"(</div>
+    content << "</div>\n";
 
+    if (candidate.closed) {
+        content << R"(
+<!-- Student Feedback -->
+<div class="card">
+    <h3 style="margin-top: 0;">Student Feedback Reports</h3>
+    <p>This position is closed; scores and feedback can no longer be changed.</p>
+)";
+        if (candidate.student_feedback.size() < candidate.feedback_size) {
+            content << R"(    <p><a href="/candidates/)" << escaped(candidate.id) << R"(/feedback">Download feedback</a> ()"
+                    << (candidate.feedback_size + 1023) / 1024 << R"( KB)</p>
+)";
+        } else if (!candidate.student_feedback.empty()) {
+            content << "    <p style=\"white-space: pre-wrap;\">" << escaped(candidate.student_feedback) << "</p>\n";
+        }
+        content << "</div>\n";
+        return base_template(candidate.name, user_name, flash, content.str());
+    }
+
+    content << R"(
 <!-- Your Score -->
 <div class="card">
     <h3 style="margin-top: 0;">Your Score</h3>
@@ -385,17 +577,77 @@ inline std::string candidate_detail_page(const std::string& user_name, const std
 <!-- Student Feedback -->
 <div class="card">
     <h3 style="margin-top: 0;">Student Feedback Reports</h3>
-    <form method="POST">
+)";
+    // Too long to edit inline: offer the stored document instead
+    if (candidate.student_feedback.size() < candidate.feedback_size) {
+        content << R"(    <p><a href="/candidates/)" << escaped(candidate.id) << R"(/feedback">Download feedback</a> ()"
+                << (candidate.feedback_size + 1023) / 1024 << R"( KB)</p>
+)";
+    } else {
+        content << R"(    <form method="POST">
         <input type="hidden" name="action" value="feedback">
         <label for="student_feedback">Historical feedback from students (optional)</label>
         <textarea id="student_feedback" name="student_feedback" placeholder="Paste student feedback or evaluations here...">)"
-            << html_escape(candidate.student_feedback) << R"(</textarea>
+            << escaped(candidate.student_feedback) << R"(</textarea>
         <button type="submit">Save Feedback</button>
     </form>
+)";
+    }
+    content << R"(    <form method="POST" action="/candidates/)" << escaped(candidate.id) << R"(/feedback" enctype="multipart/form-data">
+        <label for="feedback_file">Or upload a report as a text file</label>
+        <input type="file" id="feedback_file" name="feedback" accept="text/plain">
+        <button type="submit">Upload Feedback</button>
+    </form>
 </div>
 )";
 
     return base_template(candidate.name, user_name, flash, content.str());
 }
 
+// Borrowed view of one search result. Every string but the ids carries \x01/\x02
+// match markers (see highlighted()); valid for the duration of the callback.
+struct SearchHitView {
+    std::string_view candidate_id;
+    std::string_view position_id;
+    std::string_view position_title;
+    std::string_view name;
+    std::string_view snippet;
+    double rank;
+};
+
+// for_each(emit) calls emit(const SearchHitView&) best match first
+template <typename ForEachHit>
+inline std::string search_page(const std::string& user_name, const std::string& query,
+                               ForEachHit&& for_each_hit) {
+    std::ostringstream content;
+    content << R"(
+<div class="header-row">
+    <h2>Search</h2>
+</div>
+<form method="GET" action="/search" class="card">
+    <input type="text" name="q" value=")" << escaped(query) << R"(" placeholder="Name, position or feedback" autofocus>
+    <button type="submit">Search</button>
+</form>
+)";
+
+    int count = 0;
+    for_each_hit([&](const SearchHitView& hit) {
+        count++;
+        content << R"(<div class="card">
+    <h2><a href="/candidates/)" << escaped(hit.candidate_id) << "\">" << highlighted(hit.name) << R"(</a></h2>
+    <div class="card-meta"><a href="/positions/)" << escaped(hit.position_id) << "\">"
+                << highlighted(hit.position_title) << "</a></div>\n";
+        if (hit.snippet.find('\x01') != std::string_view::npos) {
+            content << "    <div class=\"snippet\">" << highlighted(hit.snippet) << "</div>\n";
+        }
+        content << "</div>\n";
+    });
+
+    if (count == 0 && !query.empty()) {
+        content << "<p>No candidates match <strong>" << escaped(query) << "</strong>.</p>\n";
+    }
+
+    return base_template("Search", user_name, "", content.str());
+}
+
 #endif // TEMPLATES_H
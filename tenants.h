@@ -0,0 +1,236 @@
+#ifndef TENANTS_H
+#define TENANTS_H
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "archive.h"
+#include "backfill.h"
+#include "database.h"
+#include "json.h"
+#include "ranking_hub.h"
+#include "trace.h"
+#include "vacuum.h"
+
+// One database per faculty (CANDIDATE_SCORING_TENANT_DIR=tenants).
+//
+// The SSO proxy names the caller's faculty in X-SSO-Faculty; its positions,
+// candidates and scores live in <dir>/<faculty>.db, so one faculty's write
+// burst only queues behind its own write lock and only churns its own page
+// cache. Requests without the header use the default database.
+//
+// Open tenants are kept in an LRU of up to capacity handles, each with its
+// own connection, statement cache and ranking hub. The tenant's background
+// jobs start their threads only once they have work (see each job), so an
+// open faculty that is only read costs no threads. Only idle tenants are
+// closed: one still held by a request or an event stream stays open (and
+// the pool over capacity) until it is released, so a faculty never has two
+// live handles.
+
+struct Tenant {
+    Tenant(const std::string& path, std::atomic<size_t>& watchers)
+        : db(path), hub(db, watchers), archive(db), vacuum(db), backfill(db) {}
+
+    Database db;
+    RankingHub hub;
+    ArchiveJob archive;
+    VacuumJob vacuum;
+    BackfillJob backfill;
+};
+
+class TenantPool {
+public:
+    static constexpr size_t max_name = 64;
+
+    // Opens the default tenant at default_path. dir empty: every request
+    // uses it.
+    TenantPool(const std::string& default_path, std::string dir, size_t capacity)
+        : default_(std::make_shared<Tenant>(default_path, watchers_)), dir_(std::move(dir)), capacity_(capacity) {
+        if (!dir_.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(dir_, ec);
+        }
+    }
+
+    TenantPool(const TenantPool&) = delete;
+    TenantPool& operator=(const TenantPool&) = delete;
+
+    bool enabled() const { return !dir_.empty(); }
+
+    // Requests without a faculty, and replication
+    std::shared_ptr<Tenant> fallback() const { return default_; }
+
+    // Lower-case letters, digits, '-' and '_', so a name is always a plain
+    // file name. Not ending in -archive: <name>-archive.db is the archive
+    // of <name>.db.
+    static bool valid_name(const std::string& name) {
+        static const std::string archive_suffix = "-archive";
+        if (name.empty() || name.size() > max_name) return false;
+        if (name.size() >= archive_suffix.size() &&
+            name.compare(name.size() - archive_suffix.size(), archive_suffix.size(), archive_suffix) == 0) {
+            return false;
+        }
+        return name.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789-_") == std::string::npos;
+    }
+
+    std::string path(const std::string& faculty) const { return dir_ + "/" + faculty + ".db"; }
+
+    // Every faculty with a database in the directory, open or not, sorted
+    std::vector<std::string> names() const {
+        std::vector<std::string> found;
+        if (!enabled()) return found;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+            const std::filesystem::path& file = it->path();
+            if (file.extension() != ".db" || !it->is_regular_file(ec)) continue;
+            std::string name = file.stem().string();
+            if (valid_name(name)) found.push_back(name);
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    // The faculty's tenant if it is open, else null. Leaves the LRU order
+    // alone, so background work does not keep a faculty open.
+    std::shared_ptr<Tenant> find(const std::string& faculty) {
+        std::shared_ptr<Slot> slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(faculty);
+            if (it == index_.end()) return nullptr;
+            slot = it->second->second;
+        }
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        return slot->tenant;
+    }
+
+    // The tenant for faculty, opening it if needed. Empty (or tenancy off)
+    // gives the default tenant. faculty must pass valid_name.
+    std::shared_ptr<Tenant> get(const std::string& faculty) {
+        if (faculty.empty() || !enabled()) return default_;
+        std::shared_ptr<Slot> slot;
+        std::vector<std::shared_ptr<Slot>> closing;    // closed once the lock is dropped
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(faculty);
+            if (it != index_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                hits_++;
+            } else {
+                lru_.emplace_front(faculty, std::make_shared<Slot>());
+                index_[faculty] = lru_.begin();
+                misses_++;
+                evict(closing);
+            }
+            slot = lru_.front().second;
+        }
+
+        // Opened outside the pool lock; other faculties carry on meanwhile
+        std::shared_ptr<Tenant> tenant;
+        uint64_t open_ns = 0;
+        {
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            if (!slot->tenant) {
+                TRACE_SCOPE("tenants.open");
+                uint64_t started = Tracer::now_ns();
+                slot->tenant = std::make_shared<Tenant>(path(faculty), watchers_);
+                open_ns = Tracer::now_ns() - started;
+            }
+            tenant = slot->tenant;
+        }
+        if (open_ns) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            opened_++;
+            open_ns_ += open_ns;
+        }
+        return tenant;
+    }
+
+    std::string status_json() {
+        std::vector<std::pair<std::string, std::shared_ptr<Slot>>> open;
+        std::unique_lock<std::mutex> lock(mutex_);
+        open.assign(lru_.begin(), lru_.end());
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("enabled", enabled());
+        w.field("capacity", static_cast<long long>(capacity_));
+        w.field("open", static_cast<long long>(lru_.size()));
+        w.field("hits", static_cast<long long>(hits_));
+        w.field("misses", static_cast<long long>(misses_));
+        w.field("opened", static_cast<long long>(opened_));
+        w.field("evicted", static_cast<long long>(evicted_));
+        w.key("open_ms_avg");
+        w.value(opened_ ? open_ns_ / 1e6 / opened_ : 0.0, 3);
+        lock.unlock();
+        w.key("tenants");
+        w.begin_array();
+        for (const auto& entry : open) {
+            std::shared_ptr<Tenant> tenant;
+            {
+                std::lock_guard<std::mutex> slot_lock(entry.second->mutex);
+                tenant = entry.second->tenant;
+            }
+            w.begin_object();
+            w.field("name", entry.first);
+            if (tenant) {
+                w.field("statements_prepared", static_cast<long long>(tenant->db.statements_prepared()));
+                w.field("statements_reused", static_cast<long long>(tenant->db.statements_reused()));
+            }
+            w.end_object();
+        }
+        w.end_array();
+        w.end_object();
+        return out;
+    }
+
+private:
+    struct Slot {
+        std::mutex mutex;
+        std::shared_ptr<Tenant> tenant;
+    };
+
+    // Drops least recently used idle tenants from the pool until it fits,
+    // handing them to closing. Caller holds mutex_.
+    void evict(std::vector<std::shared_ptr<Slot>>& closing) {
+        // The front entry is the one being asked for
+        auto it = lru_.end();
+        while (lru_.size() > capacity_ && --it != lru_.begin()) {
+            const std::shared_ptr<Slot>& slot = it->second;
+            // Held only by the pool: not being opened, no request or stream.
+            // A slot whose lock is taken is in use, so try_lock is enough.
+            if (slot.use_count() != 1) continue;
+            {
+                std::unique_lock<std::mutex> slot_lock(slot->mutex, std::try_to_lock);
+                if (!slot_lock.owns_lock() || (slot->tenant && slot->tenant.use_count() != 1)) continue;
+            }
+            closing.push_back(slot);
+            index_.erase(it->first);
+            it = lru_.erase(it);
+            evicted_++;
+        }
+    }
+
+    // Event streams open across every tenant's hub
+    std::atomic<size_t> watchers_{0};
+    std::shared_ptr<Tenant> default_;
+    std::string dir_;
+    size_t capacity_;
+    std::mutex mutex_;
+    // Most recently used first
+    std::list<std::pair<std::string, std::shared_ptr<Slot>>> lru_;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<Slot>>>::iterator> index_;
+    long long hits_ = 0;
+    long long misses_ = 0;
+    long long opened_ = 0;
+    long long evicted_ = 0;
+    uint64_t open_ns_ = 0;
+};
+
+#endif // TENANTS_H
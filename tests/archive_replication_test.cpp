@@ -0,0 +1,101 @@
+// Archiving a closed position deletes its hot rows on the primary. Followers
+// must keep reading it: the deletes stay out of the change log, and a
+// follower that starts after the move gets the rows from the archive.
+
+#include <unistd.h>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "database.h"
+#include "check.h"
+
+// Applies the primary's change feed to follower until it has everything
+static void sync(Database& primary, Database& follower) {
+    while (true) {
+        ChangeSet changes;
+        primary.get_changes(follower.replication_version("primary"), 1000, changes);
+        std::vector<std::string> positions;
+        CHECK(follower.apply_changes("primary", changes, positions));
+        CHECK(changes.deleted.empty());
+        if (!changes.more) break;
+    }
+}
+
+static void check_follower(Database& follower, const std::string& position, const std::string& candidate) {
+    std::string title;
+    CHECK(follower.get_position(position, title));
+    CHECK(title == "Lecturer");
+    std::vector<CandidateRanking> ranking = follower.get_candidates_for_position(position);
+    CHECK(ranking.size() == 2);
+    CandidateDetail detail;
+    ScoreStats stats;
+    MyScore mine;
+    CHECK(follower.get_candidate_detail(candidate, "u1", detail, stats, mine));
+    CHECK(detail.student_feedback == "Kept the room awake");
+    CHECK(stats.num_scores == 2);
+    std::vector<Position> positions = follower.get_positions();
+    CHECK(positions.size() == 1 && positions[0].candidate_count == 2);
+}
+
+int main() {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() /
+                                ("archive_replication_test-" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    {
+        Database primary((dir / "primary.db").string());
+        CHECK(primary.has_archive);
+        primary.ensure_user("u1", "u1@example.com", "User One");
+        primary.ensure_user("u2", "u2@example.com", "User Two");
+        std::string position = primary.create_position("Lecturer", "u1");
+        std::string ada = primary.create_candidate(position, "Ada");
+        std::string bob = primary.create_candidate(position, "Bob");
+        ScoreStats stats;
+        CHECK(primary.upsert_score(ada, "u1", 4, 5, stats));
+        CHECK(primary.upsert_score(ada, "u2", 3, 4, stats));
+        CHECK(primary.upsert_score(bob, "u1", 2, 2, stats));
+        primary.update_feedback(ada, "Kept the room awake");
+
+        Database early((dir / "early.db").string());
+        early.replica = true;
+        sync(primary, early);
+        check_follower(early, position, ada);
+
+        // Closed long enough ago for archive_step to take it; one candidate
+        // per step so every phase runs more than once
+        CHECK(!primary.close_position(position, "u2"));
+        CHECK(primary.close_position(position, "u1"));
+        CHECK(!primary.upsert_score(bob, "u2", 5, 5, stats));
+        sqlite3_exec(primary.db, "UPDATE positions SET closed_at = datetime('now', '-2 minutes')", nullptr, nullptr,
+                     nullptr);
+        Database::ArchiveStep step;
+        bool finished = false;
+        while (primary.archive_step(1, step)) finished = finished || step.finished;
+        CHECK(finished);
+        CHECK(primary.get_positions().empty());
+        std::string title;
+        CHECK(primary.get_position(position, title));
+
+        // A follower that was in sync, and one that starts after the move
+        sync(primary, early);
+        check_follower(early, position, ada);
+        Database late((dir / "late.db").string());
+        late.replica = true;
+        sync(primary, late);
+        check_follower(late, position, ada);
+
+        // Deletes outside the archive are still replicated
+        std::string other = primary.create_position("Reader", "u1");
+        std::string cara = primary.create_candidate(other, "Cara");
+        CHECK(primary.upsert_score(cara, "u1", 3, 3, stats));
+        sync(primary, late);
+        sqlite3_exec(primary.db, "DELETE FROM candidates WHERE name = 'Cara'", nullptr, nullptr, nullptr);
+        ChangeSet changes;
+        primary.get_changes(late.replication_version("primary"), 1000, changes);
+        CHECK(changes.deleted.size() == 2);
+    }
+    std::filesystem::remove_all(dir);
+    return check_failures();
+}
@@ -0,0 +1,37 @@
+// Change log triggers under the scores UPSERT. Its ON CONFLICT clause is the
+// conflict policy for every statement in the triggers it fires, so re-scoring
+// a candidate is the case that breaks them.
+
+#include <cstdio>
+#include <string>
+#include "database.h"
+#include "check.h"
+
+int main() {
+    Database db(":memory:");
+    db.ensure_user("u1", "u1@example.com", "User One");
+    std::string position = db.create_position("Lecturer", "u1");
+    std::string candidate = db.create_candidate(position, "Ada");
+
+    ScoreStats first;
+    CHECK(db.upsert_score(candidate, "u1", 2, 3, first));
+    CHECK(first.num_scores == 1);
+    ChangeSet before;
+    db.get_changes(0, 1000, before);
+    CHECK(before.scores.size() == 1);
+
+    // Same interviewer again: the UPSERT updates, the triggers renumber
+    ScoreStats second;
+    CHECK(db.upsert_score(candidate, "u1", 5, 4, second));
+    CHECK(second.num_scores == 1);
+    CHECK(second.avg_hand_gestures == 5);
+    CHECK(second.avg_stayed_awake == 4);
+
+    ChangeSet after;
+    db.get_changes(before.version, 1000, after);
+    CHECK(after.version > before.version);
+    CHECK(after.scores.size() == 1);
+    CHECK(!after.scores.empty() && after.scores[0].hand_gestures == 5);
+
+    return check_failures();
+}
@@ -0,0 +1,27 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+// Minimal assertions for the tests/ programs: a failed CHECK is reported and
+// counted, and main returns check_failures() so ctest sees a non-zero exit.
+
+inline int& check_failure_count() {
+    static int count = 0;
+    return count;
+}
+
+#define CHECK(cond)                                                                       \
+    do {                                                                                  \
+        if (!(cond)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failure_count()++;                                                      \
+        }                                                                                 \
+    } while (0)
+
+inline int check_failures() {
+    if (check_failure_count()) std::fprintf(stderr, "%d check(s) failed\n", check_failure_count());
+    return check_failure_count() ? 1 : 0;
+}
+
+#endif // CHECK_H
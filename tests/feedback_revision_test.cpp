@@ -0,0 +1,28 @@
+// Feedback revisions are numbered from 1. Revision 0 and candidates without
+// any history are not found, rather than an empty document.
+
+#include <string>
+#include "database.h"
+#include "check.h"
+
+int main() {
+    Database db(":memory:");
+    db.ensure_user("u1", "u1@example.com", "User One");
+    std::string position = db.create_position("Lecturer", "u1");
+    std::string candidate = db.create_candidate(position, "Ada");
+    db.update_feedback(candidate, "First draft");
+    db.update_feedback(candidate, "Second draft");
+
+    std::string text;
+    CHECK(db.get_feedback_revision(candidate, 1, text));
+    CHECK(text == "First draft");
+    CHECK(db.get_feedback_revision(candidate, 2, text));
+    CHECK(text == "Second draft");
+
+    CHECK(!db.get_feedback_revision(candidate, 0, text));
+    CHECK(!db.get_feedback_revision(candidate, 3, text));
+    CHECK(!db.get_feedback_revision("00000000-0000-0000-0000-000000000000", 0, text));
+    CHECK(!db.get_feedback_revision("00000000-0000-0000-0000-000000000000", 1, text));
+
+    return check_failures();
+}
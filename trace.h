@@ -0,0 +1,211 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "json.h"
+
+// Request tracing. Each thread records completed spans into its own fixed-size
+// ring buffer; the writer never takes a lock, so tracing stays on in production.
+// The buffers are exported together as Chrome trace JSON (chrome://tracing,
+// Perfetto) from /admin/trace.
+
+struct TraceEvent {
+    const char* name;        // static string, e.g. "db.get_candidate"
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t request_id;
+    char detail[64];         // truncated request path or other context
+};
+
+// One ring slot, guarded by a sequence number (a seqlock): odd while the
+// owner is writing event number index into it, 2 * index + 2 once that event
+// is complete. The event is held as words behind relaxed atomics so a reader
+// copying it while the owner overwrites it is not a data race; the reader
+// keeps the copy only if the sequence is the expected one before and after.
+struct TraceSlot {
+    static_assert(std::is_trivially_copyable<TraceEvent>::value, "TraceEvent is copied as raw words");
+    static constexpr size_t words = (sizeof(TraceEvent) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> seq{0};
+    std::array<std::atomic<uint64_t>, words> data{};
+
+    void store(uint64_t index, const TraceEvent& event) {
+        uint64_t raw[words] = {};
+        std::memcpy(raw, &event, sizeof(event));
+        seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t w = 0; w < words; w++) data[w].store(raw[w], std::memory_order_relaxed);
+        seq.store(2 * index + 2, std::memory_order_release);
+    }
+
+    // False if the slot does not hold a complete copy of event index
+    bool load(uint64_t index, TraceEvent& event) const {
+        if (seq.load(std::memory_order_acquire) != 2 * index + 2) return false;
+        uint64_t raw[words];
+        for (size_t w = 0; w < words; w++) raw[w] = data[w].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) != 2 * index + 2) return false;
+        std::memcpy(&event, raw, sizeof(event));
+        event.detail[sizeof(event.detail) - 1] = '\0';
+        return true;
+    }
+};
+
+struct TraceBuffer {
+    static constexpr size_t capacity = 4096;
+
+    uint32_t thread_index = 0;
+    std::atomic<uint64_t> head{0};
+    std::array<TraceSlot, capacity> slots;
+
+    // Only the owning thread calls push().
+    void push(const TraceEvent& event) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        slots[h % capacity].store(h, event);
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+class Tracer {
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    std::atomic<bool> enabled{true};
+
+    static uint64_t now_ns() {
+        epoch();
+        return to_ns(std::chrono::steady_clock::now());
+    }
+
+    static uint64_t to_ns(std::chrono::steady_clock::time_point t) {
+        auto base = epoch();
+        return t > base ? std::chrono::duration_cast<std::chrono::nanoseconds>(t - base).count() : 0;
+    }
+
+    // Id of the request currently being handled on this thread (0 = none)
+    static uint64_t& current_request() {
+        thread_local uint64_t id = 0;
+        return id;
+    }
+
+    uint64_t next_request_id() {
+        return request_counter_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void record(const char* name, uint64_t start_ns, uint64_t end_ns, const std::string& detail = "") {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        TraceEvent event;
+        event.name = name;
+        event.start_ns = start_ns;
+        event.duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+        event.request_id = current_request();
+        size_t n = std::min(detail.size(), sizeof(event.detail) - 1);
+        std::memcpy(event.detail, detail.data(), n);
+        event.detail[n] = '\0';
+        local_buffer().push(event);
+    }
+
+    // Snapshot every thread's ring as Chrome trace JSON. Slots the owning
+    // thread overwrote or was writing while we copied them are dropped.
+    std::string export_chrome_json() {
+        std::vector<std::shared_ptr<TraceBuffer>> buffers;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex_);
+            buffers = buffers_;
+        }
+
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto& buffer : buffers) {
+            uint64_t end = buffer->head.load(std::memory_order_acquire);
+            // The slot of event end - capacity is the one the owner fills next
+            uint64_t begin = end >= TraceBuffer::capacity ? end - TraceBuffer::capacity + 1 : 0;
+            std::vector<TraceEvent> copy;
+            copy.reserve(end - begin);
+            TraceEvent event;
+            for (uint64_t i = begin; i < end; i++) {
+                if (buffer->slots[i % TraceBuffer::capacity].load(i, event)) copy.push_back(event);
+            }
+
+            for (const TraceEvent& e : copy) {
+                if (!first) out += ',';
+                first = false;
+                char timing[96];
+                snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f",
+                         e.start_ns / 1000.0, e.duration_ns / 1000.0);
+                out += "{\"name\":\"";
+                json_escape(out, e.name);
+                out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(buffer->thread_index) + ",";
+                out += timing;
+                out += ",\"args\":{\"request\":" + std::to_string(e.request_id);
+                if (e.detail[0]) {
+                    out += ",\"detail\":\"";
+                    json_escape(out, e.detail);
+                    out += '"';
+                }
+                out += "}}";
+            }
+        }
+        out += "]}";
+        return out;
+    }
+
+private:
+    Tracer() { epoch(); }
+
+    static std::chrono::steady_clock::time_point epoch() {
+        static const auto start = std::chrono::steady_clock::now();
+        return start;
+    }
+
+    TraceBuffer& local_buffer() {
+        thread_local std::shared_ptr<TraceBuffer> buffer = register_thread();
+        return *buffer;
+    }
+
+    std::shared_ptr<TraceBuffer> register_thread() {
+        auto buffer = std::make_shared<TraceBuffer>();
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        buffer->thread_index = static_cast<uint32_t>(buffers_.size() + 1);
+        buffers_.push_back(buffer);
+        return buffer;
+    }
+
+    std::atomic<uint64_t> request_counter_{0};
+    std::mutex registry_mutex_;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers_;
+};
+
+// Records a span covering the enclosing scope
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(name), start_(Tracer::now_ns()) {}
+    ~TraceScope() { Tracer::instance().record(name_, start_, Tracer::now_ns()); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif // TRACE_H
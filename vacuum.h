@@ -0,0 +1,255 @@
+#ifndef VACUUM_H
+#define VACUUM_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sqlite3.h>
+#include "database.h"
+#include "json.h"
+#include "trace.h"
+
+// Gives pages freed by deletes and archiving back to the file system.
+//
+// Every database is opened with auto_vacuum = INCREMENTAL. A background
+// thread looks at the free-page counts every check_interval; when nothing
+// was written since the last look, it runs PRAGMA incremental_vacuum on
+// each database pages_per_step pages at a time, pausing between steps and
+// backing off as soon as writes resume. keep_free_pages are left for new
+// rows to reuse. POST /admin/vacuum runs a pass now, busy or not. The
+// thread starts when there is something to release: at open if a database
+// is over keep_free_pages, else from wake() or start().
+//
+// Incremental vacuum fills gaps with pages from the end of the file, so it
+// shrinks the file but does not put tables back in order. After each pass
+// the job measures fragmentation, the share of b-tree leaf pages that do
+// not follow their neighbour on disk, on a connection of its own.
+
+class VacuumJob {
+public:
+    static constexpr int pages_per_step = 128;
+    static constexpr long long keep_free_pages = 256;
+    static constexpr auto step_pause = std::chrono::milliseconds(5);
+    static constexpr auto check_interval = std::chrono::seconds(10);
+
+    explicit VacuumJob(Database& db) : db_(db) {
+        for (const std::string& schema : schemas()) {
+            Database::PageStats stats = db_.page_stats(schema);
+            if (stats.incremental && stats.free_pages > keep_free_pages) {
+                worker_ = std::thread([this] { run(); });
+                break;
+            }
+        }
+    }
+
+    ~VacuumJob() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    VacuumJob(const VacuumJob&) = delete;
+    VacuumJob& operator=(const VacuumJob&) = delete;
+
+    // Queues a pass now. False if one is already queued or running.
+    bool start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (requested_ || status_.running) return false;
+        requested_ = true;
+        launch();
+        cv_.notify_all();
+        return true;
+    }
+
+    // Call after writes that free pages (closing a position, which the
+    // archive job later deletes); starts the periodic checks
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        launch();
+    }
+
+    // Current size and free space of each database, and what the job has
+    // released so far
+    std::string status_json() {
+        std::vector<std::pair<std::string, Database::PageStats>> files;
+        for (const std::string& schema : schemas()) files.emplace_back(schema, db_.page_stats(schema));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Status& s = status_;
+        std::string out;
+        JsonWriter w(out);
+        w.begin_object();
+        w.field("state", s.running ? "running" : requested_ ? "queued" : "idle");
+        w.key("databases");
+        w.begin_array();
+        for (const auto& file : files) {
+            const Database::PageStats& p = file.second;
+            w.begin_object();
+            w.field("name", file.first);
+            w.field("incremental", p.incremental);
+            w.field("page_size", p.page_size);
+            w.field("pages", p.pages);
+            w.field("free_pages", p.free_pages);
+            w.key("free_ratio");
+            w.value(p.pages ? static_cast<double>(p.free_pages) / p.pages : 0.0, 4);
+            w.key("size_mb");
+            w.value(p.pages * p.page_size / 1e6, 1);
+            auto measured = s.fragmentation.find(file.first);
+            if (measured != s.fragmentation.end()) {
+                w.key("fragmentation");
+                w.value(measured->second, 4);
+            }
+            w.end_object();
+        }
+        w.end_array();
+        w.field("passes", s.passes);
+        w.field("steps", s.steps);
+        w.field("pages_released", s.released);
+        w.field("deferred", s.deferred);
+        w.key("lock_ms_total");
+        w.value(s.lock_ns / 1e6, 3);
+        w.key("lock_ms_max");
+        w.value(s.lock_max_ns / 1e6, 3);
+        w.key("wait_ms_total");
+        w.value(s.wait_ns / 1e6, 3);
+        w.end_object();
+        return out;
+    }
+
+private:
+    struct Status {
+        bool running = false;
+        long long passes = 0;
+        long long steps = 0;
+        long long released = 0;     // pages given back
+        long long deferred = 0;     // passes cut short by writes
+        std::map<std::string, double> fragmentation;
+        uint64_t lock_ns = 0;       // holding the shared connection
+        uint64_t lock_max_ns = 0;
+        uint64_t wait_ns = 0;       // waiting for it
+    };
+
+    std::vector<std::string> schemas() const {
+        std::vector<std::string> names{"main"};
+        if (db_.has_archive) names.push_back("archive");
+        return names;
+    }
+
+    // Caller holds mutex_
+    void launch() {
+        if (!worker_.joinable()) worker_ = std::thread([this] { run(); });
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        long long seen = -1;
+        while (!stopping_) {
+            cv_.wait_for(lock, check_interval, [this] { return stopping_ || requested_; });
+            if (stopping_) break;
+            bool forced = requested_;
+            requested_ = false;
+            long long changes = db_.total_changes();
+            bool idle = changes == seen;
+            seen = changes;
+            if (!forced && !idle) continue;
+            status_.running = true;
+            bool measured = !status_.fragmentation.empty();
+            lock.unlock();
+            if (vacuum(forced) || !measured) measure_fragmentation();
+            lock.lock();
+            status_.running = false;
+        }
+    }
+
+    // Releases free pages until each database is down to keep_free_pages.
+    // Returns true if any were released.
+    bool vacuum(bool forced) {
+        TRACE_SCOPE("vacuum");
+        sqlite3_mutex* conn = sqlite3_db_mutex(db_.db);
+        long long changes = db_.total_changes();
+        bool released = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            status_.passes++;
+        }
+        for (const std::string& schema : schemas()) {
+            while (true) {
+                Database::PageStats before = db_.page_stats(schema);
+                if (!before.incremental || before.free_pages <= keep_free_pages) break;
+                if (!forced && db_.total_changes() != changes) {
+                    // Writes are back; try again when it is quiet
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    status_.deferred++;
+                    return released;
+                }
+                int pages = static_cast<int>(std::min<long long>(pages_per_step, before.free_pages - keep_free_pages));
+                uint64_t asked = Tracer::now_ns();
+                sqlite3_mutex_enter(conn);
+                uint64_t held = Tracer::now_ns();
+                db_.incremental_vacuum(schema, pages);
+                uint64_t done = Tracer::now_ns();
+                sqlite3_mutex_leave(conn);
+                long long freed = before.free_pages - db_.page_stats(schema).free_pages;
+                released = released || freed > 0;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    status_.steps++;
+                    status_.released += std::max(freed, 0LL);
+                    status_.wait_ns += held - asked;
+                    status_.lock_ns += done - held;
+                    status_.lock_max_ns = std::max(status_.lock_max_ns, done - held);
+                    if (stopping_ || freed <= 0) break;
+                }
+                std::this_thread::sleep_for(step_pause);
+            }
+        }
+        return released;
+    }
+
+    // Share of each b-tree's leaf pages not stored right after the previous
+    // leaf, from dbstat on a read-only connection of the job's own
+    void measure_fragmentation() {
+        TRACE_SCOPE("vacuum.fragmentation");
+        std::map<std::string, double> measured;
+        for (const std::string& schema : schemas()) {
+            const char* path = sqlite3_db_filename(db_.db, schema.c_str());
+            sqlite3* conn = nullptr;
+            if (!path || !*path || sqlite3_open_v2(path, &conn, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+                sqlite3_close(conn);
+                continue;
+            }
+            sqlite3_stmt* stmt;
+            sqlite3_prepare_v2(conn, R"(
+                SELECT COUNT(*), SUM(prev IS NOT NULL AND pageno != prev + 1)
+                FROM (SELECT pageno, LAG(pageno) OVER (PARTITION BY name ORDER BY path) AS prev
+                      FROM dbstat WHERE pagetype = 'leaf')
+            )", -1, &stmt, nullptr);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                long long leaves = sqlite3_column_int64(stmt, 0);
+                measured[schema] = leaves ? static_cast<double>(sqlite3_column_int64(stmt, 1)) / leaves : 0.0;
+            }
+            sqlite3_finalize(stmt);
+            sqlite3_close(conn);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        status_.fragmentation = measured;
+    }
+
+    Database& db_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    bool requested_ = false;
+    Status status_;
+    std::thread worker_;
+};
+
+#endif // VACUUM_H